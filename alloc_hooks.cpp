@@ -0,0 +1,117 @@
+// Replaces the global operator new and delete to count heap allocations per
+// subsystem. Linked into executables only, see alloc_tracker.h.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "alloc_tracker.h"
+
+namespace {
+
+// Right before every block: who allocated it, and how far before the block
+// the one from malloc starts.
+struct alignas(std::max_align_t) BlockHeader {
+  uint32_t owner;
+  uint32_t offset;
+};
+
+void* allocate(std::size_t size, std::size_t alignment) {
+  Subsystem owner = countAllocation(size);
+  std::size_t offset = std::max(sizeof(BlockHeader), alignment);
+  void* base;
+  if (alignment > alignof(std::max_align_t)) {
+    // aligned_alloc wants a multiple of the alignment
+    std::size_t total = (offset + size + alignment - 1) / alignment * alignment;
+    base = std::aligned_alloc(alignment, total);
+  } else {
+    base = std::malloc(offset + size);
+  }
+  if (!base) {
+    throw std::bad_alloc();
+  }
+  auto* block = static_cast<char*>(base) + offset;
+  new (block - sizeof(BlockHeader)) BlockHeader{
+      static_cast<uint32_t>(owner), static_cast<uint32_t>(offset)};
+  return block;
+}
+
+void* allocate(std::size_t size, std::size_t alignment,
+               const std::nothrow_t&) noexcept {
+  try {
+    return allocate(size, alignment);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void release(void* p) {
+  if (!p) {
+    return;
+  }
+  auto* block = static_cast<char*>(p);
+  const auto* header =
+      reinterpret_cast<const BlockHeader*>(block - sizeof(BlockHeader));
+  countFree(static_cast<Subsystem>(header->owner));
+  std::free(block - header->offset);
+}
+
+constexpr std::size_t default_alignment = alignof(std::max_align_t);
+
+[[maybe_unused]] const bool hooked = (enableAllocationTracking(), true);
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  return allocate(size, default_alignment);
+}
+void* operator new[](std::size_t size) {
+  return allocate(size, default_alignment);
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, const std::nothrow_t& tag) noexcept {
+  return allocate(size, default_alignment, tag);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+  return allocate(size, default_alignment, tag);
+}
+void* operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t& tag) noexcept {
+  return allocate(size, static_cast<std::size_t>(alignment), tag);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t& tag) noexcept {
+  return allocate(size, static_cast<std::size_t>(alignment), tag);
+}
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, std::size_t) noexcept { release(p); }
+void operator delete[](void* p, std::size_t) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  release(p);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+  release(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  release(p);
+}
+void operator delete(void* p, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  release(p);
+}
+void operator delete[](void* p, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  release(p);
+}
@@ -0,0 +1,76 @@
+#include "alloc_tracker.h"
+
+#include <atomic>
+
+namespace {
+
+struct AtomicCounts {
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> frees{0};
+  std::atomic<uint64_t> bytes{0};
+};
+
+AtomicCounts counts[subsystem_count];
+thread_local Subsystem current = Subsystem::OTHER;
+std::atomic<bool> enabled{false};
+
+}  // namespace
+
+const char* subsystemName(Subsystem subsystem) {
+  switch (subsystem) {
+    case Subsystem::OTHER:
+      return "other";
+    case Subsystem::SIMULATION:
+      return "simulation";
+    case Subsystem::GENERATION:
+      return "generation";
+    case Subsystem::RENDERING:
+      return "rendering";
+    case Subsystem::COUNT:
+      break;
+  }
+  return "?";
+}
+
+bool allocationTrackingEnabled() {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+void enableAllocationTracking() {
+  enabled.store(true, std::memory_order_relaxed);
+}
+
+Subsystem countAllocation(size_t bytes) {
+  Subsystem owner = current;
+  AtomicCounts& c = counts[static_cast<size_t>(owner)];
+  c.allocations.fetch_add(1, std::memory_order_relaxed);
+  c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+  return owner;
+}
+
+void countFree(Subsystem owner) {
+  counts[static_cast<size_t>(owner)].frees.fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+AllocationCounts allocationCounts(Subsystem subsystem) {
+  const AtomicCounts& c = counts[static_cast<size_t>(subsystem)];
+  return {c.allocations.load(std::memory_order_relaxed),
+          c.frees.load(std::memory_order_relaxed),
+          c.bytes.load(std::memory_order_relaxed)};
+}
+
+AllocationCounts allocationCounts() {
+  AllocationCounts total;
+  for (size_t i = 0; i < subsystem_count; ++i) {
+    total += allocationCounts(static_cast<Subsystem>(i));
+  }
+  return total;
+}
+
+AllocationScope::AllocationScope(Subsystem subsystem)
+    : previous_(current) {
+  current = subsystem;
+}
+
+AllocationScope::~AllocationScope() { current = previous_; }
@@ -0,0 +1,70 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Heap allocations are only counted in executables that link
+// alloc_hooks.cpp, which replaces the global operator new and delete; with
+// HSS_TRACK_ALLOCATIONS the build links it into headless and HSS only, never
+// into the game library or libhssenv. Otherwise every count stays 0 and
+// scopes cost a thread local store.
+
+// Who allocated, in the order they are reported.
+enum class Subsystem {
+  OTHER,
+  SIMULATION,
+  GENERATION,
+  RENDERING,
+  COUNT,
+};
+
+constexpr size_t subsystem_count = static_cast<size_t>(Subsystem::COUNT);
+
+const char* subsystemName(Subsystem subsystem);
+
+struct AllocationCounts {
+  uint64_t allocations = 0;
+  uint64_t frees = 0;
+  uint64_t bytes = 0;  // allocated
+
+  AllocationCounts operator-(const AllocationCounts& other) const {
+    return {allocations - other.allocations, frees - other.frees,
+            bytes - other.bytes};
+  }
+  AllocationCounts& operator+=(const AllocationCounts& other) {
+    allocations += other.allocations;
+    frees += other.frees;
+    bytes += other.bytes;
+    return *this;
+  }
+};
+
+bool allocationTrackingEnabled();
+
+// Totals since start up, per subsystem and over all of them. Take the
+// difference of two readings for a tick or a frame.
+AllocationCounts allocationCounts(Subsystem subsystem);
+AllocationCounts allocationCounts();
+
+// For the hooks: charges an allocation to this thread's subsystem and
+// returns it, so that freeing the block can be charged to the same one.
+void enableAllocationTracking();
+Subsystem countAllocation(size_t bytes);
+void countFree(Subsystem owner);
+
+// Charges this thread's allocations to `subsystem` while alive; scopes nest.
+class AllocationScope
+{
+ public:
+  explicit AllocationScope(Subsystem subsystem);
+  ~AllocationScope();
+
+  AllocationScope(const AllocationScope&) = delete;
+  AllocationScope& operator=(const AllocationScope&) = delete;
+
+ private:
+  Subsystem previous_;
+};
+
+#endif  // ALLOC_TRACKER_H
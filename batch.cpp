@@ -0,0 +1,148 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+GameResult runGame(const BatchConfig& config, int seed) {
+  Game game(seed, config.startx);
+  game.started = true;
+
+  std::mt19937 policy_generator(seed);
+  std::uniform_int_distribution<int> d_mask(0, commandBit(Command::GIVE_UP) - 1);
+  std::uniform_int_distribution<int> d_hold(1, 30);
+  CommandMask commands = 0;
+  int hold = 0;
+
+  GameResult result = {.seed = seed};
+  uint32_t tick = 0;
+  // stop once the collapse after game over has played out
+  while (tick < config.max_ticks &&
+         !(game.gameover && game.cave.boulders.empty())) {
+    switch (config.policy) {
+      case Policy::IDLE:
+        break;
+      case Policy::RANDOM:
+        if (--hold <= 0) {
+          commands = d_mask(policy_generator);
+          hold = d_hold(policy_generator);
+        }
+        break;
+      case Policy::SCRIPT:
+        commands = tick < config.script->commands.size()
+                       ? config.script->commands[tick]
+                       : 0;
+        break;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    game.step(commands, config.tick_ms);
+    std::chrono::duration<double, std::nano> cost =
+        std::chrono::steady_clock::now() - start;
+    result.cost.add(cost.count());
+    ++tick;
+  }
+
+  result.score = game.score;
+  result.distance = game.distance();
+  result.death_cause = game.death_cause;
+  result.ticks = tick;
+  return result;
+}
+
+template <typename T>
+T percentile(std::vector<T> values, double p) {
+  if (values.empty()) {
+    return T();
+  }
+  size_t i = std::min<size_t>(values.size() * p, values.size() - 1);
+  std::nth_element(values.begin(), values.begin() + i, values.end());
+  return values[i];
+}
+
+}  // namespace
+
+void TickCost::add(double ns) {
+  int bucket = ns > 1 ? static_cast<int>(2 * std::log2(ns)) : 0;
+  ++buckets[std::min<int>(bucket, buckets.size() - 1)];
+  ++ticks;
+  total_ns += ns;
+}
+
+void TickCost::merge(const TickCost& other) {
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    buckets[i] += other.buckets[i];
+  }
+  ticks += other.ticks;
+  total_ns += other.total_ns;
+}
+
+double TickCost::percentile(double p) const {
+  uint64_t rank = ticks * p;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen > rank) {
+      // upper edge of the bucket
+      return std::exp2((i + 1) / 2.);
+    }
+  }
+  return 0;
+}
+
+std::vector<GameResult> runBatch(const BatchConfig& config, ThreadPool& pool) {
+  std::vector<GameResult> results(config.games);
+  pool.parallelFor(config.games, [&](size_t i) {
+    results[i] = runGame(config, config.first_seed + i);
+  });
+  return results;
+}
+
+std::string batchReport(const std::vector<GameResult>& results,
+                        double wall_seconds, size_t threads) {
+  std::vector<int64_t> scores;
+  std::vector<double> distances;
+  std::array<size_t, 4> causes = {};
+  TickCost cost;
+  uint64_t ticks = 0;
+  for (const auto& result : results) {
+    scores.push_back(result.score);
+    distances.push_back(result.distance);
+    ++causes[static_cast<int>(result.death_cause)];
+    cost.merge(result.cost);
+    ticks += result.ticks;
+  }
+
+  double score_mean = 0;
+  double distance_mean = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    score_mean += scores[i] / static_cast<double>(results.size());
+    distance_mean += distances[i] / results.size();
+  }
+
+  char buff[1024];
+  snprintf(buff, sizeof(buff),
+           "games: %zu on %zu threads in %.2f s (%.0f games/s, %.0f ticks/s)\n"
+           "score: mean %.0f, p50 %lld, p90 %lld, max %lld\n"
+           "distance: mean %.2f, p50 %.2f, p90 %.2f, max %.2f\n"
+           "death: boulder %zu, spit %zu, gave up %zu, survived %zu\n"
+           "tick cost: mean %.0f ns, p50 %.0f ns, p99 %.0f ns\n",
+           results.size(), threads, wall_seconds,
+           results.size() / wall_seconds, ticks / wall_seconds, score_mean,
+           static_cast<long long>(percentile(scores, 0.5)),
+           static_cast<long long>(percentile(scores, 0.9)),
+           static_cast<long long>(percentile(scores, 1.)), distance_mean,
+           percentile(distances, 0.5), percentile(distances, 0.9),
+           percentile(distances, 1.),
+           causes[static_cast<int>(DeathCause::BOULDER)],
+           causes[static_cast<int>(DeathCause::SPIT)],
+           causes[static_cast<int>(DeathCause::GIVE_UP)],
+           causes[static_cast<int>(DeathCause::NONE)],
+           cost.ticks ? cost.total_ns / cost.ticks : 0.,
+           cost.percentile(0.5), cost.percentile(0.99));
+  return buff;
+}
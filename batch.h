@@ -0,0 +1,53 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "game.h"
+#include "replay.h"
+#include "thread_pool.h"
+
+enum class Policy {
+  IDLE,
+  RANDOM,  // random commands held for random durations
+  SCRIPT,  // the same replayed commands for every seed
+};
+
+struct BatchConfig {
+  size_t games = 1000;
+  int first_seed = 0;
+  double startx = 0;  // where in the cave the ship starts
+  uint32_t max_ticks = 100000;
+  uint32_t tick_ms = default_tick_ms;
+  Policy policy = Policy::RANDOM;
+  const Replay* script = nullptr;
+};
+
+// Tick cost histogram with buckets growing by sqrt(2) from 1ns.
+struct TickCost {
+  std::array<uint64_t, 80> buckets = {};
+  uint64_t ticks = 0;
+  double total_ns = 0;
+
+  void add(double ns);
+  void merge(const TickCost& other);
+  double percentile(double p) const;
+};
+
+struct GameResult {
+  int seed;
+  int64_t score;
+  double distance;
+  DeathCause death_cause;
+  uint32_t ticks;
+  TickCost cost;
+};
+
+std::vector<GameResult> runBatch(const BatchConfig& config, ThreadPool& pool);
+std::string batchReport(const std::vector<GameResult>& results,
+                        double wall_seconds, size_t threads);
+
+#endif  // BATCH_H
@@ -1,59 +1,140 @@
 #include "cave.h"
 
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "alloc_tracker.h"
 #include "util.h"
 
 constexpr int density = 80;
 constexpr float envelope_presicion = 1.f / 128.f;
 constexpr float spider_probability = 0.1;
-constexpr float formation_probablity = 0.005;
+
+// Room reserved up front so that containers don't grow as spiders get
+// denser; spawning saturates at one spider per envelope sample, a few
+// hundred over the generated span.
+constexpr size_t reserved_spiders = 512;
+constexpr size_t reserved_spits = 1024;
+constexpr size_t reserved_bullets = 64;
+constexpr size_t reserved_background_lines = 64;
+// formations per world unit, growing with the distance travelled
+constexpr float formation_rate = 0.125;
+constexpr float formation_rate_growth = 0.025;
 constexpr float background_line_probablity = 1;
-constexpr float background_line_shade_shift_probablity = 0.1;
+// chunks between the random shades the background fades through
+constexpr int background_shade_period = 8;
+constexpr uint64_t background_shade_salt = 0x5ade;
 
 Cave::Cave(int seed)
-    : cave_generator_(seed) {
-  BackgroundLine firstLine = {
-      .biome = Biome::CAVERN,
-      .shade = 0,
-      .vertices = {{0, 0}, {0, 1}},
-  };
-  background.push_back(firstLine);
+    : seed_(seed) {
+  floor_spiders.reserve(reserved_spiders);
+  bullets.reserve(reserved_bullets);
+  spits.reserve(reserved_spits);
+  background.reserve(reserved_background_lines);
+}
+
+int64_t Cave::chunkAt(float x) const {
+  return origin_ + static_cast<int64_t>(std::floor(x / chunk_width));
+}
+
+float Cave::chunkStart(int64_t chunk) const {
+  return (chunk - origin_) * chunk_width;
+}
+
+int64_t Cave::origin() const { return origin_; }
+
+double Cave::worldX(float x) const {
+  return origin_ * static_cast<double>(chunk_width) + x;
+}
+
+void Cave::rebase(int64_t chunks) {
+  // a multiple of 1/128, so envelope keys stay on their grid
+  const float shift = chunks * chunk_width;
+  const float background_shift = chunks * (chunk_width * 1.1);
+  origin_ += chunks;
+
+  // a uniform shift keeps the keys in order
+  for (auto& [x, boulder] : boulders) {
+    x -= shift;
+    boulder.x -= shift;
+  }
+  for (auto& [x, y] : floor_envelope) {
+    x -= shift;
+  }
+  for (auto& spider : floor_spiders) {
+    spider.x -= shift;
+    spider.from -= shift;
+    spider.to -= shift;
+  }
+  for (auto& bullet : bullets) {
+    bullet.x -= shift;
+  }
+  for (auto& spit : spits) {
+    spit.x -= shift;
+  }
+  for (auto& particle : debris) {
+    particle.x -= shift;
+  }
+  for (auto& line : background) {
+    for (auto& vertex : line.vertices) {
+      vertex.x -= background_shift;
+    }
+  }
+  job_.startx -= shift;
+  job_.endx -= shift;
+  job_.x -= shift;
 }
 
-std::vector<Point> Cave::generateBackgroundLineVertices(float x) {
-  static std::uniform_real_distribution<float> d(0, 1);
-  static std::uniform_int_distribution<int> d_vertex_count(5, 10);
+// Smoothed value noise over the chunk index.
+int Cave::backgroundShade(int64_t chunk) const {
+  auto lattice = [this](int64_t cell) {
+    uint64_t bits = hash64(hash64(seed_, background_shade_salt), cell);
+    return (bits >> 11) * 0x1.0p-53;
+  };
+  double t = static_cast<double>(chunk) / background_shade_period;
+  double cell = std::floor(t);
+  double f = t - cell;
+  f = f * f * (3 - 2 * f);
+  double a = lattice(static_cast<int64_t>(cell));
+  double b = lattice(static_cast<int64_t>(cell) + 1);
+  return 1 + static_cast<int>((a + (b - a) * f) * 46);
+}
 
-  int vertice_count = d_vertex_count(cave_generator_);
+FixedVector<Point, background_line_max_vertices>
+Cave::generateBackgroundLineVertices(float x) {
+  int vertice_count = d_vertex_count_(cave_generator_);
   const float h_spread = .5 / vertice_count;
   const float v_spread = 1. / vertice_count;
-  std::vector<Point> vertices;
+  FixedVector<Point, background_line_max_vertices> vertices;
   vertices.push_back({
-      .x = x + d(cave_generator_) * h_spread,
+      .x = x + d_unit_(cave_generator_) * h_spread,
       .y = 0,
   });
   for (int j = 1; j < vertice_count - 1; ++j) {
     vertices.push_back({
-        .x = x + d(cave_generator_) * h_spread,
-        .y = j * v_spread + d(cave_generator_) * v_spread,
+        .x = x + d_unit_(cave_generator_) * h_spread,
+        .y = j * v_spread + d_unit_(cave_generator_) * v_spread,
     });
   }
   vertices.push_back({
-      .x = x + d(cave_generator_) * h_spread,
+      .x = x + d_unit_(cave_generator_) * h_spread,
       .y = 1.,
   });
 
   return vertices;
 }
 
-std::vector<Point> Cave::generateBoulderVertices(float radius) {
-  static std::uniform_real_distribution<float> d(0, 1);
-  static std::uniform_int_distribution<int> d_vertex_count(5, 10);
-
-  int vertice_count = d_vertex_count(cave_generator_);
-  std::vector<Point> vertices;
+FixedVector<Point, boulder_max_vertices> Cave::generateBoulderVertices(
+    float radius) {
+  int vertice_count = d_vertex_count_(cave_generator_);
+  FixedVector<Point, boulder_max_vertices> vertices;
   for (int j = 0; j < vertice_count; ++j) {
-    float ur = (d(cave_generator_) * 0.2 + 0.8) * radius;
-    float skew = (d(cave_generator_) * 0.2 - 0.1) * 2 * M_PI;
+    float ur = (d_unit_(cave_generator_) * 0.2 + 0.8) * radius;
+    float skew = (d_unit_(cave_generator_) * 0.2 - 0.1) * 2 * M_PI;
     float vx = ur * sin(2 * M_PI * j / vertice_count + skew);
     float vy = ur * cos(2 * M_PI * j / vertice_count + skew);
     vertices.push_back({vx, vy});
@@ -62,15 +143,67 @@ std::vector<Point> Cave::generateBoulderVertices(float radius) {
   return vertices;
 }
 
-void Cave::explodeBoulder(const Boulder &boulder) {
-  static std::uniform_real_distribution<float> d_angle(-M_PI / 2, M_PI);
-  static std::uniform_real_distribution<float> d_ejection_angle(
-      M_PI / 4 + M_PI / 2, M_PI * 2 / 3 + M_PI / 2);
+float envelopeRound(float f) {
+  int n = f / envelope_presicion;
+  return n * envelope_presicion;
+}
+
+BoulderHull boulderHull(
+    const FixedVector<Point, boulder_max_vertices> &vertices) {
+  BoulderHull hull;
+  for (int k = 0; k < 3; ++k) {
+    hull.nx[k].fill(0.f);
+    hull.ny[k].fill(0.f);
+    hull.d[k].fill(-std::numeric_limits<float>::max());
+  }
+
+  const Point origin = {0.f, 0.f};
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    const Point &a = vertices[i];
+    const Point &b = vertices[(i + 1) % vertices.size()];
+    float cross = a.x * b.y - a.y * b.x;
+    if (fabs(cross) < 1e-9f) {
+      continue;
+    }
+    float orientation = cross > 0 ? 1.f : -1.f;
+    const std::array<std::array<Point, 2>, 3> edges = {
+        {{origin, a}, {a, b}, {b, origin}}};
+    for (int k = 0; k < 3; ++k) {
+      float ex = edges[k][1].x - edges[k][0].x;
+      float ey = edges[k][1].y - edges[k][0].y;
+      float len = sqrtf(ex * ex + ey * ey);
+      float nx = orientation * ey / len;
+      float ny = -orientation * ex / len;
+      hull.nx[k][i] = nx;
+      hull.ny[k][i] = ny;
+      hull.d[k][i] = nx * edges[k][0].x + ny * edges[k][0].y;
+    }
+  }
+
+  return hull;
+}
+
+bool boulderHit(const Boulder &boulder, float x, float y, float r) {
+  const BoulderHull &hull = boulder.hull;
+  const float px = x - boulder.x;
+  const float py = y - boulder.y;
+
+  // branch-free over all lanes so that the loop vectorizes
+  int hits = 0;
+  for (int i = 0; i < boulder_hull_lanes; ++i) {
+    float s0 = hull.nx[0][i] * px + hull.ny[0][i] * py - hull.d[0][i];
+    float s1 = hull.nx[1][i] * px + hull.ny[1][i] * py - hull.d[1][i];
+    float s2 = hull.nx[2][i] * px + hull.ny[2][i] * py - hull.d[2][i];
+    hits |= std::max(s0, std::max(s1, s2)) < r;
+  }
+  return hits;
+}
 
+void Cave::explodeBoulder(const Boulder &boulder) {
   for (size_t i = 0; i < boulder.vertices.size(); ++i) {
     size_t a = i % boulder.vertices.size();
     size_t b = (i + 1) % boulder.vertices.size();
-    float theta = d_angle(random_generator_);
+    float theta = d_debris_angle_(random_generator_);
     std::array<Point, 2> vertices = {
         {{boulder.vertices[a].x, boulder.vertices[a].y},
          {boulder.vertices[b].x, boulder.vertices[b].y}}};
@@ -82,10 +215,11 @@ void Cave::explodeBoulder(const Boulder &boulder) {
                       .shade = boulder.shade,
                       .vertices = vertices};
     debris.push_back(d);
+    ++counters.debris_spawned;
   }
 
   for (auto &spider : floor_spiders) {
-    float theta = d_ejection_angle(random_generator_);
+    float theta = d_ejection_angle_(random_generator_);
     if (sqdist(spider.x, spider.y, boulder.x, boulder.y) <
         boulder.r * boulder.r * 1.4) {
       spider.walking = false;
@@ -95,9 +229,18 @@ void Cave::explodeBoulder(const Boulder &boulder) {
   }
 }
 
-void Cave::spiderSpit(const Spider &spider, const Ship &ship) {
-  static std::uniform_real_distribution<float> d_r(0.004, 0.007);
+double spiderProbability(double world_x) {
+  return spider_probability * envelope_presicion * (100 + world_x) / 100;
+}
 
+void mergeParticle(Debris &into, const Debris &from) {
+  into.vx = (into.vx + from.vx) / 2;
+  into.vy = (into.vy + from.vy) / 2;
+  into.shade = std::max(into.shade, from.shade);
+  into.ttl = std::max(into.ttl, from.ttl);
+}
+
+void Cave::spiderSpit(const Spider &spider, const Ship &ship) {
   float vx =
       (ship.x + ship.multiplier * ship.speed / spider.spit_speed - spider.x) *
       spider.spit_speed;
@@ -108,140 +251,670 @@ void Cave::spiderSpit(const Spider &spider, const Ship &ship) {
       .y = spider.y,
       .vx = vx,
       .vy = vy,
-      .r = d_r(random_generator_),
+      .r = d_spit_r_(random_generator_),
   });
 }
 
-float envelopeRound(float f) {
-  int n = f / envelope_presicion;
-  return n * envelope_presicion;
+// Distance along the ray (dx, dy) to the nearest of `count` circles, given
+// relative to the ray origin; count is a multiple of raycast_lanes.
+float rayCircles(const float *cxs, const float *cys, const float *cs,
+                 size_t count, float dx, float dy, float max_distance) {
+  // t = b - sqrt(b^2 - c) is the nearer intersection, 0 inside a circle
+#ifdef __SSE__
+  const __m128 vdx = _mm_set1_ps(dx);
+  const __m128 vdy = _mm_set1_ps(dy);
+  const __m128 vmax = _mm_set1_ps(max_distance);
+  const __m128 zero = _mm_setzero_ps();
+  __m128 best = vmax;
+  for (size_t j = 0; j < count; j += raycast_lanes) {
+    __m128 b = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(cxs + j), vdx),
+                          _mm_mul_ps(_mm_loadu_ps(cys + j), vdy));
+    __m128 c = _mm_loadu_ps(cs + j);
+    __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), c);
+    __m128 hit = _mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_cmpgt_ps(b, zero));
+    __m128 inside = _mm_cmplt_ps(c, zero);
+    if (!_mm_movemask_ps(_mm_or_ps(hit, inside))) {
+      continue;
+    }
+    __m128 t = _mm_sub_ps(b, _mm_sqrt_ps(_mm_max_ps(disc, zero)));
+    t = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, vmax));
+    t = _mm_andnot_ps(inside, t);
+    best = _mm_min_ps(best, t);
+  }
+  float lanes[raycast_lanes];
+  _mm_storeu_ps(lanes, best);
+  return std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+#else
+  float best = max_distance;
+  for (size_t j = 0; j < count; ++j) {
+    float b = cxs[j] * dx + cys[j] * dy;
+    float c = cs[j];
+    float disc = b * b - c;
+    float t = disc >= 0 && b > 0 ? b - sqrtf(disc) : max_distance;
+    best = std::min(best, c < 0 ? 0.f : t);
+  }
+  return best;
+#endif
+}
+
+// Distance along the ray (dx, dy), dx != 0, to the first of `count` floor
+// envelope samples that lies above it, given relative to the ray origin;
+// count is a multiple of raycast_lanes.
+float rayFloor(const float *exs, const float *eys, size_t count, float dx,
+               float dy, float max_distance) {
+  const float slope = dy / dx;
+  const float inverse = 1 / dx;
+#ifdef __SSE__
+  const __m128 vslope = _mm_set1_ps(slope);
+  const __m128 vinverse = _mm_set1_ps(inverse);
+  const __m128 vmax = _mm_set1_ps(max_distance);
+  const __m128 zero = _mm_setzero_ps();
+  __m128 best = vmax;
+  for (size_t j = 0; j < count; j += raycast_lanes) {
+    __m128 ex = _mm_loadu_ps(exs + j);
+    __m128 ey = _mm_loadu_ps(eys + j);
+    __m128 t = _mm_mul_ps(ex, vinverse);
+    __m128 hit = _mm_and_ps(_mm_cmple_ps(ey, _mm_mul_ps(ex, vslope)),
+                            _mm_cmpge_ps(t, zero));
+    best = _mm_min_ps(best, _mm_or_ps(_mm_and_ps(hit, t),
+                                      _mm_andnot_ps(hit, vmax)));
+  }
+  float lanes[raycast_lanes];
+  _mm_storeu_ps(lanes, best);
+  return std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+#else
+  float best = max_distance;
+  for (size_t j = 0; j < count; ++j) {
+    float t = exs[j] * inverse;
+    if (eys[j] <= exs[j] * slope && t >= 0) {
+      best = std::min(best, t);
+    }
+  }
+  return best;
+#endif
+}
+
+void Cave::raycast(float x, float y, const float *dx, const float *dy,
+                   int count, float max_distance, float *distances,
+                   RaycastScratch &scratch) const {
+  scratch.cx.clear();
+  scratch.cy.clear();
+  scratch.c.clear();
+  const float reach = max_distance + boulder_max_radius;
+  auto last = boulders.upper_bound(x + reach);
+  for (auto it = boulders.lower_bound(x - reach); it != last; ++it) {
+    const Boulder &boulder = it->second;
+    float cx = boulder.x - x;
+    float cy = boulder.y - y;
+    float r = max_distance + boulder.r;
+    if (boulder.dead || cx * cx + cy * cy > r * r) {
+      continue;
+    }
+    scratch.cx.push_back(cx);
+    scratch.cy.push_back(cy);
+    scratch.c.push_back(cx * cx + cy * cy - boulder.r * boulder.r);
+  }
+  // padding entries have no real radius and never hit
+  while (scratch.c.size() % raycast_lanes) {
+    scratch.cx.push_back(0.f);
+    scratch.cy.push_back(0.f);
+    scratch.c.push_back(1.f);
+  }
+
+  scratch.ex.clear();
+  scratch.ey.clear();
+  auto last_sample = floor_envelope.upper_bound(x + max_distance);
+  for (auto it = floor_envelope.lower_bound(x - max_distance);
+       it != last_sample; ++it) {
+    scratch.ex.push_back(it->first - x);
+    scratch.ey.push_back(it->second - y);
+  }
+  // padding samples lie infinitely far below every ray
+  while (scratch.ex.size() % raycast_lanes) {
+    scratch.ex.push_back(0.f);
+    scratch.ey.push_back(std::numeric_limits<float>::max());
+  }
+
+  const float *cxs = scratch.cx.data();
+  const float *cys = scratch.cy.data();
+  const float *cs = scratch.c.data();
+  const size_t candidates = scratch.c.size();
+
+  for (int i = 0; i < count; ++i) {
+    const float rdx = dx[i];
+    const float rdy = dy[i];
+    float distance =
+        rayCircles(cxs, cys, cs, candidates, rdx, rdy, max_distance);
+
+    // floor envelope
+    if (fabs(rdx) < 1e-6f) {
+      auto it = floor_envelope.lower_bound(envelopeRound(x));
+      if (rdy > 0 && it != floor_envelope.end()) {
+        distance = std::min(distance, std::max(it->second - y, 0.f));
+      }
+    } else {
+      distance = std::min(
+          distance, rayFloor(scratch.ex.data(), scratch.ey.data(),
+                             scratch.ex.size(), rdx, rdy, max_distance));
+    }
+
+    distances[i] = distance;
+  }
+}
+
+MemoryUsage Cave::memoryUsage() const {
+  using BoulderEntry = decltype(boulders)::Entry;
+  using EnvelopeEntry = decltype(floor_envelope)::Entry;
+
+  MemoryUsage usage;
+  usage[Container::BOULDERS] = {
+      .count = boulders.size(),
+      .live_bytes = boulders.size() * sizeof(BoulderEntry),
+      .allocated_bytes = boulders.capacity() * sizeof(BoulderEntry),
+  };
+  usage[Container::ENVELOPE] = {
+      .count = floor_envelope.size(),
+      .live_bytes = floor_envelope.size() * sizeof(EnvelopeEntry),
+      .allocated_bytes = floor_envelope.capacity() * sizeof(EnvelopeEntry),
+  };
+  usage[Container::BACKGROUND] = {
+      .count = background.size(),
+      .live_bytes = background.size() * sizeof(BackgroundLine),
+      .allocated_bytes = background.capacity() * sizeof(BackgroundLine),
+  };
+  usage[Container::SPIDERS] = {
+      .count = floor_spiders.size(),
+      .live_bytes = floor_spiders.size() * sizeof(Spider),
+      .allocated_bytes = floor_spiders.capacity() * sizeof(Spider),
+  };
+  usage[Container::BULLETS] = {
+      .count = bullets.size(),
+      .live_bytes = bullets.size() * sizeof(Bullet),
+      .allocated_bytes = bullets.capacity() * sizeof(Bullet),
+  };
+  usage[Container::SPITS] = {
+      .count = spits.size(),
+      .live_bytes = spits.size() * sizeof(Spit),
+      .allocated_bytes = spits.capacity() * sizeof(Spit),
+  };
+  usage[Container::DEBRIS] = {
+      .count = debris.size(),
+      .live_bytes = debris.size() * sizeof(Debris),
+      .allocated_bytes = debris.capacity() * sizeof(Debris),
+  };
+  for (size_t i = 0; i < container_count; ++i) {
+    usage.containers[i].evicted = evicted_[i];
+  }
+  return usage;
+}
+
+void Cave::enforceLimits(const MemoryLimits &limits) {
+  using BoulderEntry = decltype(boulders)::Entry;
+  using EnvelopeEntry = decltype(floor_envelope)::Entry;
+
+  // The oldest elements beyond what fits are evicted, then storage that
+  // grew past the limit, e.g. in a spike, is given back, so that allocated
+  // bytes and not only live ones are within the limits after every tick.
+  auto trim = [&](auto &container, Container which, size_t max_count) {
+    while (container.size() > max_count) {
+      container.pop_front();
+      ++evicted_[static_cast<size_t>(which)];
+    }
+    container.shrink(max_count);
+  };
+  auto trimMap = [&](auto &map, Container which, size_t max_count) {
+    if (map.size() > max_count) {
+      size_t excess = map.size() - max_count;
+      map.erase(map.begin(), map.begin() + excess);
+      evicted_[static_cast<size_t>(which)] += excess;
+    }
+    map.shrink(max_count);
+  };
+  // rings hold a power of two
+  auto ringCount = [&](Container which, size_t element_size) {
+    return RingBuffer<char>::capacityWithin(
+        limits.maxCount(which, element_size));
+  };
+
+  if (limits[Container::BOULDERS]) {
+    trimMap(boulders, Container::BOULDERS,
+            limits.maxCount(Container::BOULDERS, sizeof(BoulderEntry)));
+  }
+  if (limits[Container::ENVELOPE]) {
+    trimMap(floor_envelope, Container::ENVELOPE,
+            limits.maxCount(Container::ENVELOPE, sizeof(EnvelopeEntry)));
+  }
+  if (limits[Container::BACKGROUND]) {
+    trim(background, Container::BACKGROUND,
+         ringCount(Container::BACKGROUND, sizeof(BackgroundLine)));
+  }
+  if (limits[Container::SPIDERS]) {
+    trim(floor_spiders, Container::SPIDERS,
+         ringCount(Container::SPIDERS, sizeof(Spider)));
+  }
+  if (limits[Container::BULLETS]) {
+    trim(bullets, Container::BULLETS,
+         ringCount(Container::BULLETS, sizeof(Bullet)));
+  }
+  if (limits[Container::SPITS]) {
+    trim(spits, Container::SPITS, ringCount(Container::SPITS, sizeof(Spit)));
+  }
+  if (limits[Container::DEBRIS]) {
+    trim(debris, Container::DEBRIS,
+         limits.maxCount(Container::DEBRIS, sizeof(Debris)));
+  }
+}
+
+void Cave::save(SnapshotWriter &writer) const {
+  writer.writeRange(boulders);
+  writer.writeRange(floor_envelope);
+  writer.writeRange(floor_spiders);
+  writer.writeRange(bullets);
+  writer.writeRange(spits);
+  writer.write(debris.capacity());
+  writer.write(debris.policy());
+  writer.writeRange(debris);
+  writer.writeRange(background);
+  writer.write(stats);
+  writer.write(job_);
+  writer.write(seed_);
+  writer.write(origin_);
+  writer.write(evicted_);
+  writer.write(generated_);
+  writer.write(cave_generator_);
+  writer.write(random_generator_);
+}
+
+void hashBoulder(Hasher &hasher, const Boulder &boulder) {
+  hasher.add(boulder.biome);
+  hasher.add(boulder.x);
+  hasher.add(boulder.y);
+  hasher.add(boulder.r);
+  hasher.add(boulder.shade);
+  hasher.add(boulder.health);
+  hasher.add(boulder.destructible);
+  hasher.add(boulder.dead);
+  hasher.add(boulder.damaged_cooldown);
+  for (const Point &vertex : boulder.vertices) {
+    hasher.add(vertex.x, vertex.y);
+  }
+  for (int edge = 0; edge < 3; ++edge) {
+    for (int lane = 0; lane < boulder_hull_lanes; ++lane) {
+      hasher.add(boulder.hull.nx[edge][lane], boulder.hull.ny[edge][lane]);
+      hasher.add(boulder.hull.d[edge][lane]);
+    }
+  }
 }
 
-void Cave::generate(float startx, float endx) {
-  static std::uniform_real_distribution<float> d(0, 1);
-  static std::uniform_int_distribution<int> d_shade(0, 47);
-  static std::uniform_real_distribution<float> d_radius(0.02, 0.1);
-  static std::uniform_real_distribution<float> d_spider_r(0.008, 0.012);
-  static std::uniform_real_distribution<float> d_spider_speed(0.75, 1.5);
-  static std::uniform_int_distribution<int> d_spider_burst_rate(1, 5);
-  static std::uniform_real_distribution<float> d_spider_fire_rate(0.5, 1.5);
-  static std::uniform_real_distribution<float> d_spider_burst_fire_rate(0.1,
-                                                                        0.2);
-  static std::uniform_real_distribution<float> d_spider_spit_speed(1., 2.);
-
-  // background
-  if (d(cave_generator_) < background_line_probablity) {
-    BackgroundLine bl = {
-        .biome = Biome::CAVERN,
-        .shade = background_line_shade,
-        .vertices = generateBackgroundLineVertices(endx * 1.1),
-    };
-    background.push_back(bl);
-  }
-  background_line_shade += background_line_shade_direction;
-  if (background_line_shade == 1 && background_line_shade_direction == -1) {
-    background_line_shade_direction = 1;
-  } else if (background_line_shade == 47 &&
-             background_line_shade_direction == 1) {
-    background_line_shade_direction = -1;
-  } else if (d(cave_generator_) < background_line_shade_shift_probablity) {
-    background_line_shade_direction *= -1;
-  }
-
-  // ceiling
-  for (int i = 0; i < static_cast<int>(density * (endx - startx)); ++i) {
-    float x = startx + d(cave_generator_) * (endx - startx);
-    float y = d(cave_generator_) * fabs(sin(x)) * 0.3 - 0.05;
-
-    float radius = d_radius(cave_generator_);
-    int shade = d_shade(cave_generator_);
-
-    Boulder p = {
-        .x = x,
-        .y = y,
-        .r = radius,
-        .shade = shade,
-        .health = static_cast<int>(radius * 1000),
-        .vertices = generateBoulderVertices(radius),
-    };
-    boulders.emplace(x, p);
-  }
-
-  // floor
-  for (int i = 0; i < static_cast<int>(density * (endx - startx)); ++i) {
-    float x = startx + d(cave_generator_) * (endx - startx);
-    float y = d(cave_generator_) * -fabs(cos(x) + sin(3 * x)) * 0.3 + 1.05;
-    if (endx < 2) {
-      y = std::max(y, 0.85f);
+void hashSpider(Hasher &hasher, const Spider &spider) {
+  hasher.add(spider.x, spider.y);
+  hasher.add(spider.vx, spider.vy);
+  hasher.add(spider.from, spider.to);
+  hasher.add(spider.t, spider.r);
+  hasher.add(spider.speed, spider.health);
+  hasher.add(spider.burst_rate, spider.burst);
+  hasher.add(spider.cooldown, spider.fire_rate);
+  hasher.add(spider.burst_fire_rate, spider.spit_speed);
+  hasher.add(static_cast<uint64_t>(spider.walking) |
+             static_cast<uint64_t>(spider.forward) << 1 |
+             static_cast<uint64_t>(spider.dead) << 2 |
+             static_cast<uint64_t>(spider.smart) << 3);
+}
+
+void hashBackgroundLine(Hasher &hasher, const BackgroundLine &line) {
+  hasher.add(line.biome);
+  hasher.add(line.shade);
+  for (const Point &vertex : line.vertices) {
+    hasher.add(vertex.x, vertex.y);
+  }
+}
+
+void Cave::hashState(StateHash &hash) const {
+  Hasher random;
+  random.addBytes(cave_generator_);
+  random.addBytes(random_generator_);
+  hash[StateSection::RANDOM] = random.value();
+
+  // shapes were hashed when generated; positions move on rebase and
+  // eviction, health and cooldowns on hits. The envelope and background
+  // are walked whole, since rebase and eviction rewrite every entry.
+  Hasher hasher;
+  hasher.add(static_cast<uint64_t>(boulders.size()));
+  for (const auto &[x, boulder] : boulders) {
+    hasher.add(x, boulder.health);
+    hasher.add(boulder.damaged_cooldown, static_cast<uint32_t>(boulder.dead));
+  }
+  hash[StateSection::BOULDERS] = hasher.value();
+
+  hasher = {};
+  hasher.add(static_cast<uint64_t>(floor_envelope.size()));
+  for (const auto &[x, y] : floor_envelope) {
+    hasher.add(x, y);
+  }
+  hash[StateSection::ENVELOPE] = hasher.value();
+
+  hasher = {};
+  hasher.add(static_cast<uint64_t>(floor_spiders.size()));
+  for (const Spider &spider : floor_spiders) {
+    hashSpider(hasher, spider);
+  }
+  hash[StateSection::SPIDERS] = hasher.value();
+
+  hasher = {};
+  hasher.add(static_cast<uint64_t>(bullets.size()));
+  for (const Bullet &bullet : bullets) {
+    hasher.add(bullet.x, bullet.y);
+    hasher.add(bullet.vx, bullet.vy);
+    hasher.add(bullet.nx, bullet.ny);
+    hasher.add(bullet.damage, static_cast<uint32_t>(bullet.dead));
+  }
+  hash[StateSection::BULLETS] = hasher.value();
+
+  hasher = {};
+  hasher.add(static_cast<uint64_t>(spits.size()));
+  for (const Spit &spit : spits) {
+    hasher.add(spit.x, spit.y);
+    hasher.add(spit.vx, spit.vy);
+    hasher.add(spit.r, static_cast<uint32_t>(spit.dead));
+  }
+  hash[StateSection::SPITS] = hasher.value();
+
+  hasher = {};
+  hasher.add(static_cast<uint64_t>(debris.size()));
+  for (const Debris &d : debris) {
+    hasher.add(d.x, d.y);
+    hasher.add(d.vx, d.vy);
+    hasher.add(d.am, d.ttl);
+    hasher.add(d.shade, static_cast<uint32_t>(d.dead));
+    for (const Point &vertex : d.vertices) {
+      hasher.add(vertex.x, vertex.y);
+    }
+  }
+  hash[StateSection::DEBRIS] = hasher.value();
+
+  hasher = {};
+  hasher.add(static_cast<uint64_t>(background.size()));
+  for (const BackgroundLine &line : background) {
+    hasher.add(static_cast<uint32_t>(line.biome), line.shade);
+    hasher.add(static_cast<uint64_t>(line.vertices.size()));
+    for (const Point &vertex : line.vertices) {
+      hasher.add(vertex.x, vertex.y);
     }
+  }
+  hash[StateSection::BACKGROUND] = hasher.value();
+
+  hasher = generated_;
+  hasher.add(origin_);
+  hasher.add(job_.phase);
+  hasher.add(job_.chunk);
+  hasher.add(job_.startx);
+  hasher.add(job_.endx);
+  hasher.add(job_.i);
+  hasher.add(job_.count);
+  hasher.add(job_.sampling);
+  hasher.add(job_.x);
+  hasher.add(job_.y);
+  hasher.add(job_.radius);
+  hasher.add(job_.lx);
+  hasher.add(job_.shade);
+  hasher.add(stats.boulders);
+  hasher.add(stats.formations);
+  hasher.add(stats.spiders);
+  for (size_t evicted : evicted_) {
+    hasher.add(static_cast<uint64_t>(evicted));
+  }
+  hash[StateSection::GENERATION] = hasher.value();
+}
+
+void Cave::restore(SnapshotReader &reader) {
+  reader.readRange(boulders);
+  reader.readRange(floor_envelope);
+  reader.readRange(floor_spiders);
+  reader.readRange(bullets);
+  reader.readRange(spits);
+  auto debris_capacity = reader.read<size_t>();
+  auto debris_policy = reader.read<OverflowPolicy>();
+  if (!reader.ok() || debris_capacity == 0 ||
+      debris_capacity > max_debris_budget) {
+    reader.fail();
+    return;
+  }
+  if (debris.capacity() != debris_capacity ||
+      debris.policy() != debris_policy) {
+    debris.configure(debris_capacity, debris_policy);
+  }
+  reader.readRange(debris);
+  reader.readRange(background);
+  reader.read(stats);
+  reader.read(job_);
+  reader.read(seed_);
+  reader.read(origin_);
+  reader.read(evicted_);
+  reader.read(generated_);
+  reader.read(cave_generator_);
+  reader.read(random_generator_);
+}
+
+void Cave::generateChunk(int64_t chunk) {
+  beginChunk(chunk);
+  generateStep(std::numeric_limits<int>::max());
+}
+
+void Cave::beginChunk(int64_t chunk) {
+  if (generating()) {
+    generateStep(std::numeric_limits<int>::max());
+  }
+  job_ = {
+      .phase = GenerationPhase::BACKGROUND,
+      .chunk = chunk,
+      .startx = chunkStart(chunk),
+      .endx = chunkStart(chunk + 1),
+  };
+  cave_generator_.seed(hash64(seed_, chunk));
+}
+
+bool Cave::generating() const { return job_.phase != GenerationPhase::DONE; }
+
+float Cave::generationStart() const { return job_.startx; }
+
+bool Cave::generateStep(int budget) {
+  AllocationScope scope(Subsystem::GENERATION);
+
+  GenerationJob &job = job_;
+  const float startx = job.startx;
+  const float endx = job.endx;
+  // shapes and difficulty follow the absolute position
+  const double world_startx = worldX(startx);
+  const double world_endx = worldX(endx);
+
+  while (budget > 0 && job.phase != GenerationPhase::DONE) {
+    switch (job.phase) {
+      case GenerationPhase::BACKGROUND: {
+        // the background scrolls faster; lines start a chunk behind so that
+        // the first one is left of the screen
+        if (d_unit_(cave_generator_) < background_line_probablity) {
+          BackgroundLine bl = {
+              .biome = Biome::CAVERN,
+              .shade = backgroundShade(job.chunk),
+              .vertices =
+                  generateBackgroundLineVertices((startx - chunk_width) * 1.1),
+          };
+          background.push_back(bl);
+          hashBackgroundLine(generated_, bl);
+        }
 
-    float radius = d_radius(cave_generator_);
-    int shade = d_shade(cave_generator_);
-
-    float lx = -radius;
-    while (lx < radius) {
-      float ex = envelopeRound(x + lx);
-      float coslx = (lx / radius);
-      float ley = y - sqrt(1 - coslx * coslx) * radius;
-      lx += envelope_presicion;
-      if (!floor_envelope.count(ex) || floor_envelope[ex] > ley) {
-        floor_envelope[ex] = ley;
+        job.phase = GenerationPhase::CEILING;
+        job.i = 0;
+        job.count = static_cast<int>(density * (endx - startx));
+        break;
       }
-      if (endx > 2.4) {
-        if (d(cave_generator_) < spider_probability * envelope_presicion *
-                                     (100.f + startx) / 100.f) {
-          float spider_r = d_spider_r(cave_generator_);
-          float spider_speed = d_spider_speed(cave_generator_);
-          floor_spiders.push_back({
-              .x = ex,
-              .y = floor_envelope[ex],
-              .walking = true,
-              .from = ex,
-              .to = ex - envelope_presicion,
-              .t = 0,
-              .r = spider_r,
-              .speed = spider_speed,
-              .health = 10,
-              .forward = true,
-              .burst_rate = d_spider_burst_rate(cave_generator_),
-              .burst = 0,
-              .cooldown = 0.f,
-              .fire_rate = d_spider_fire_rate(cave_generator_),
-              .burst_fire_rate = d_spider_burst_fire_rate(cave_generator_),
-              .spit_speed = d_spider_spit_speed(cave_generator_),
-          });
+
+      case GenerationPhase::CEILING: {
+        if (job.i == job.count) {
+          job.phase = GenerationPhase::FLOOR;
+          job.i = 0;
+          job.sampling = false;
+          break;
         }
+
+        float x = startx + d_unit_(cave_generator_) * (endx - startx);
+        float y = d_unit_(cave_generator_) * fabs(sin(worldX(x))) * 0.3 - 0.05;
+
+        float radius = d_radius_(cave_generator_);
+        int shade = d_shade_(cave_generator_);
+
+        auto vertices = generateBoulderVertices(radius);
+        Boulder p = {
+            .x = x,
+            .y = y,
+            .r = radius,
+            .shade = shade,
+            .health = static_cast<int>(radius * 1000),
+            .vertices = vertices,
+            .hull = boulderHull(vertices),
+        };
+        boulders.emplace(x, p);
+        hashBoulder(generated_, p);
+        ++stats.boulders;
+        ++counters.boulders_generated;
+        ++job.i;
+        --budget;
+        break;
       }
-    }
 
-    Boulder p = {.x = x,
-                 .y = y,
-                 .r = radius,
-                 .shade = shade,
-                 .health = static_cast<int>(radius * 3000),
-                 .vertices = generateBoulderVertices(radius)};
-    boulders.emplace(x, p);
-  }
-
-  // formations
-  float p_formation = d(cave_generator_);
-  if (p_formation * (endx - startx) <
-      formation_probablity + (startx / 1000.f)) {
-    float length = endx - startx;
-    for (int i = 0; i < static_cast<int>(density * length * 0.5); ++i) {
-      float x = startx + 0.25 * length + d(cave_generator_) * 0.5 * length;
-      float y = d(cave_generator_) * fabs(sin(x)) * 0.95 - 0.05;
-
-      float radius = d_radius(cave_generator_) * (1 + ((0.5 - y) * (0.5 - y)));
-      int shade = d_shade(cave_generator_);
-
-      Boulder p = {.x = x,
-                   .y = y,
-                   .r = radius,
-                   .shade = shade,
-                   .health = static_cast<int>(radius * 1000),
-                   .vertices = generateBoulderVertices(radius)};
-      boulders.emplace(x, p);
+      case GenerationPhase::FLOOR: {
+        if (!job.sampling) {
+          if (job.i == job.count) {
+            float p_formation = d_unit_(cave_generator_);
+            job.phase = GenerationPhase::FORMATIONS;
+            job.i = 0;
+            job.count = 0;
+            if (p_formation <
+                (formation_rate + world_startx * formation_rate_growth) *
+                    (endx - startx)) {
+              job.count = static_cast<int>(density * (endx - startx) * 0.5);
+              ++stats.formations;
+            }
+            break;
+          }
+
+          job.x = startx + d_unit_(cave_generator_) * (endx - startx);
+          double world_x = worldX(job.x);
+          job.y = d_unit_(cave_generator_) *
+                      -fabs(cos(world_x) + sin(3 * world_x)) * 0.3 +
+                  1.05;
+          if (world_endx < 2) {
+            job.y = std::max(job.y, 0.85f);
+          }
+
+          job.radius = d_radius_(cave_generator_);
+          job.shade = d_shade_(cave_generator_);
+          job.lx = -job.radius;
+          job.sampling = true;
+          break;
+        }
+
+        const float x = job.x;
+        const float y = job.y;
+        const float radius = job.radius;
+
+        if (job.lx < radius) {
+          float lx = job.lx;
+          float ex = envelopeRound(x + lx);
+          float coslx = (lx / radius);
+          float ley = y - sqrt(1 - coslx * coslx) * radius;
+          job.lx += envelope_presicion;
+          ++counters.envelope_samples;
+          if (!floor_envelope.count(ex) || floor_envelope[ex] > ley) {
+            floor_envelope[ex] = ley;
+            generated_.add(ex);
+            generated_.add(ley);
+          }
+          if (world_endx > 2.4) {
+            if (d_unit_(cave_generator_) < spiderProbability(world_startx)) {
+              float spider_r = d_spider_r_(cave_generator_);
+              float spider_speed = d_spider_speed_(cave_generator_);
+              floor_spiders.push_back({
+                  .x = ex,
+                  .y = floor_envelope[ex],
+                  .walking = true,
+                  .from = ex,
+                  .to = ex - envelope_presicion,
+                  .t = 0,
+                  .r = spider_r,
+                  .speed = spider_speed,
+                  .health = 10,
+                  .forward = true,
+                  .burst_rate = d_spider_burst_rate_(cave_generator_),
+                  .burst = 0,
+                  .cooldown = 0.f,
+                  .fire_rate = d_spider_fire_rate_(cave_generator_),
+                  .burst_fire_rate = d_spider_burst_fire_rate_(cave_generator_),
+                  .spit_speed = d_spider_spit_speed_(cave_generator_),
+              });
+              hashSpider(generated_, floor_spiders.back());
+              ++stats.spiders;
+              ++counters.spiders_generated;
+            }
+          }
+          --budget;
+          break;
+        }
+
+        auto vertices = generateBoulderVertices(radius);
+        Boulder p = {.x = x,
+                     .y = y,
+                     .r = radius,
+                     .shade = job.shade,
+                     .health = static_cast<int>(radius * 3000),
+                     .vertices = vertices,
+                     .hull = boulderHull(vertices)};
+        boulders.emplace(x, p);
+        hashBoulder(generated_, p);
+        ++stats.boulders;
+        ++counters.boulders_generated;
+        job.sampling = false;
+        ++job.i;
+        --budget;
+        break;
+      }
+
+      case GenerationPhase::FORMATIONS: {
+        if (job.i == job.count) {
+          job.phase = GenerationPhase::DONE;
+          break;
+        }
+
+        float length = endx - startx;
+        float x = startx + 0.25 * length + d_unit_(cave_generator_) * 0.5 * length;
+        float y =
+            d_unit_(cave_generator_) * fabs(sin(worldX(x))) * 0.95 - 0.05;
+
+        float radius =
+            d_radius_(cave_generator_) * (1 + ((0.5 - y) * (0.5 - y)));
+        int shade = d_shade_(cave_generator_);
+
+        auto vertices = generateBoulderVertices(radius);
+        Boulder p = {.x = x,
+                     .y = y,
+                     .r = radius,
+                     .shade = shade,
+                     .health = static_cast<int>(radius * 1000),
+                     .vertices = vertices,
+                     .hull = boulderHull(vertices)};
+        boulders.emplace(x, p);
+        hashBoulder(generated_, p);
+        ++stats.boulders;
+        ++counters.boulders_generated;
+        ++job.i;
+        --budget;
+        break;
+      }
+
+      case GenerationPhase::DONE:
+        break;
     }
   }
+
+  return job.phase == GenerationPhase::DONE;
 }
@@ -3,12 +3,33 @@
 
 #include <array>
 #include <cstdint>
-#include <deque>
-#include <map>
 #include <random>
 #include <vector>
 
+#include "fixed_vector.h"
+#include "flat_map.h"
+#include "memory.h"
+#include "pool.h"
+#include "ring_buffer.h"
+#include "snapshot.h"
+#include "state_hash.h"
+#include "util.h"
+
 constexpr int ship_max_health = 1000;
+constexpr int boulder_max_vertices = 10;
+constexpr int background_line_max_vertices = 10;
+// boulder_max_vertices rounded up to a multiple of the SIMD width
+constexpr int boulder_hull_lanes = 12;
+// formation boulders grow up to 1.3 times the largest generated radius
+constexpr float boulder_max_radius = 0.13;
+// rays are tested against boulders in batches of this many (SSE width)
+constexpr int raycast_lanes = 4;
+// the world is generated in chunks of this width
+constexpr float chunk_width = 0.25;
+constexpr size_t default_debris_budget = 2048;
+// largest budget accepted, e.g. from a snapshot
+constexpr size_t max_debris_budget = 1 << 20;
+constexpr float debris_lifetime = 4.f;
 
 enum class Biome {
   CAVERN,
@@ -18,6 +39,15 @@ struct Point {
   float x, y;
 };
 
+// Outward unit normals and offsets of the three edges of every triangle in
+// the fan a boulder is drawn with, one lane per triangle. Unused lanes never
+// report a hit.
+struct BoulderHull {
+  std::array<std::array<float, boulder_hull_lanes>, 3> nx;
+  std::array<std::array<float, boulder_hull_lanes>, 3> ny;
+  std::array<std::array<float, boulder_hull_lanes>, 3> d;
+};
+
 struct Boulder {
   Biome biome;
   float x, y;
@@ -27,7 +57,8 @@ struct Boulder {
   bool destructible;
   bool dead;
   uint32_t damaged_cooldown;
-  const std::vector<Point> vertices;
+  FixedVector<Point, boulder_max_vertices> vertices;
+  BoulderHull hull;
 };
 
 struct Ship {
@@ -55,9 +86,12 @@ struct Debris {
   float vx, vy;
   int shade;
   bool dead;
-  const std::array<Point, 2> vertices;
+  std::array<Point, 2> vertices;
+  float ttl = debris_lifetime;
 };
 
+void mergeParticle(Debris& into, const Debris& from);
+
 struct Spider {
   float x, y;
   bool walking;
@@ -88,7 +122,79 @@ struct Spit {
 struct BackgroundLine {
   Biome biome;
   int shade;
-  std::vector<Point> vertices;
+  FixedVector<Point, background_line_max_vertices> vertices;
+};
+
+// Chance of a spider per envelope sample at an absolute position; the cave
+// gets more crowded the further it goes.
+double spiderProbability(double world_x);
+
+// Exact test of a circle of radius r (0 for a point) against the drawn
+// outline of a boulder. Callers are expected to reject by bounding radius
+// first.
+bool boulderHit(const Boulder& boulder, float x, float y, float r);
+
+enum class GenerationPhase {
+  BACKGROUND,
+  CEILING,
+  FLOOR,
+  FORMATIONS,
+  DONE,
+};
+
+// Progress through a slice of the cave so that generation can be resumed.
+struct GenerationJob {
+  GenerationPhase phase = GenerationPhase::DONE;
+  int64_t chunk;
+  float startx, endx;
+  int i, count;
+
+  // floor boulder whose envelope is being sampled
+  bool sampling;
+  float x, y;
+  float radius;
+  float lx;
+  int shade;
+};
+
+// Candidates of Cave::raycast relative to the ray origin, padded to
+// raycast_lanes; kept by the caller so that their storage is reused.
+struct RaycastScratch {
+  std::vector<float> cx;
+  std::vector<float> cy;
+  std::vector<float> c;  // squared distance minus squared radius
+  std::vector<float> ex;
+  std::vector<float> ey;
+};
+
+// Totals of what generation produced so far, unaffected by eviction.
+struct GenerationStats {
+  uint32_t boulders = 0;
+  uint32_t formations = 0;
+  uint32_t spiders = 0;
+};
+
+// Work done by the simulation in one tick; Game::update resets it. Not part
+// of snapshots.
+struct TickCounters {
+  uint32_t collision_candidates = 0;  // boulders tested against ship/bullets
+  uint32_t collision_hits = 0;
+  uint32_t map_nodes_visited = 0;  // boulder entries walked in range scans
+  uint32_t boulders_generated = 0;
+  uint32_t envelope_samples = 0;
+  uint32_t spiders_generated = 0;
+  uint32_t debris_spawned = 0;
+
+  TickCounters& operator+=(const TickCounters& other) {
+    collision_candidates += other.collision_candidates;
+    collision_hits += other.collision_hits;
+    map_nodes_visited += other.map_nodes_visited;
+    boulders_generated += other.boulders_generated;
+    envelope_samples += other.envelope_samples;
+    spiders_generated += other.spiders_generated;
+    debris_spawned += other.debris_spawned;
+    return *this;
+  }
 };
 
 class Cave
@@ -96,28 +202,94 @@ class Cave
  public:
   Cave(int seed = 0);
 
-  void generate(float startx, float endx);
+  // The content of a chunk only depends on the seed and the chunk index, so
+  // chunks can be generated in any order, e.g. to start far into the cave.
+  // A chunk has to be evicted before it is generated again.
+  int64_t chunkAt(float x) const;
+  float chunkStart(int64_t chunk) const;
+  void generateChunk(int64_t chunk);
+  void beginChunk(int64_t chunk);
+  // Generates at most `budget` boulders and envelope samples of the chunk
+  // started by beginChunk. Returns true once the chunk is complete.
+  bool generateStep(int budget);
+  bool generating() const;
+  float generationStart() const;
   void explodeBoulder(const Boulder& boulder);
   void spiderSpit(const Spider& spider, const Ship& ship);
 
+  // Casts `count` rays from (x, y) along the unit vectors (dx[i], dy[i]) and
+  // writes the distance to the first boulder or floor hit, up to
+  // max_distance, to distances[i]. Reentrant: every caller brings scratch
+  // space of its own. 32 rays of 0.5 cost about 3.5 us mid-run, up to 7 us
+  // with the caches cold after a tick.
+  void raycast(float x, float y, const float* dx, const float* dy, int count,
+               float max_distance, float* distances,
+               RaycastScratch& scratch) const;
+
+  // Positions are stored relative to the start of the origin chunk so that
+  // floats keep the same precision however far the cave goes.
+  int64_t origin() const;
+  double worldX(float x) const;
+  // Moves the origin `chunks` chunks forward and every position back by the
+  // same, exactly representable, distance.
+  void rebase(int64_t chunks);
+
+  // Per container element counts and bytes.
+  MemoryUsage memoryUsage() const;
+  // Drops the oldest elements of every container over its limit and gives
+  // back storage beyond it.
+  void enforceLimits(const MemoryLimits& limits);
+
+  void save(SnapshotWriter& writer) const;
+  void restore(SnapshotReader& reader);
+  // Fills in every section but GAME and SHIP. What generation produced is
+  // hashed once as it is produced, so per tick only what can change since
+  // is walked; that is still every boulder, envelope point, spider, bullet
+  // and piece of debris, most of Game::stateHash's cost.
+  void hashState(StateHash& hash) const;
+
  public:
-  std::map<float, Boulder> boulders;
-  std::map<float, float> floor_envelope;
-  std::deque<Spider> floor_spiders;
-  std::deque<Bullet> bullets;
-  std::deque<Spit> spits;
-  std::deque<Debris> debris;
-  std::deque<BackgroundLine> background;
+  FlatMap<float, Boulder> boulders;
+  FlatMap<float, float> floor_envelope;
+  RingBuffer<Spider> floor_spiders;
+  RingBuffer<Bullet> bullets;
+  RingBuffer<Spit> spits;
+  ParticlePool<Debris> debris{default_debris_budget};
+  RingBuffer<BackgroundLine> background;
+  GenerationStats stats;
+  TickCounters counters;
 
  private:
-  std::vector<Point> generateBoulderVertices(float radius);
-  std::vector<Point> generateBackgroundLineVertices(float x);
+  FixedVector<Point, boulder_max_vertices> generateBoulderVertices(
+      float radius);
+  FixedVector<Point, background_line_max_vertices>
+  generateBackgroundLineVertices(float x);
+  int backgroundShade(int64_t chunk) const;
 
-  int background_line_shade = 10;
-  int background_line_shade_direction = 1;
+  GenerationJob job_;
 
+  int seed_;
+  int64_t origin_ = 0;
+  std::array<size_t, container_count> evicted_ = {};
+  Hasher generated_;
   std::default_random_engine cave_generator_;
   std::default_random_engine random_generator_;
+
+  // per instance so that caves can be generated on several threads
+  std::uniform_real_distribution<float> d_unit_{0, 1};
+  std::uniform_int_distribution<int> d_vertex_count_{5, 10};
+  std::uniform_int_distribution<int> d_shade_{0, 47};
+  std::uniform_real_distribution<float> d_radius_{0.02, 0.1};
+  std::uniform_real_distribution<float> d_spider_r_{0.008, 0.012};
+  std::uniform_real_distribution<float> d_spider_speed_{0.75, 1.5};
+  std::uniform_int_distribution<int> d_spider_burst_rate_{1, 5};
+  std::uniform_real_distribution<float> d_spider_fire_rate_{0.5, 1.5};
+  std::uniform_real_distribution<float> d_spider_burst_fire_rate_{0.1, 0.2};
+  std::uniform_real_distribution<float> d_spider_spit_speed_{1., 2.};
+  std::uniform_real_distribution<float> d_debris_angle_{-M_PI / 2, M_PI};
+  std::uniform_real_distribution<float> d_ejection_angle_{
+      M_PI / 4 + M_PI / 2, M_PI * 2 / 3 + M_PI / 2};
+  std::uniform_real_distribution<float> d_spit_r_{0.004, 0.007};
 };
 
 #endif // CAVE_H
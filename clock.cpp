@@ -0,0 +1,97 @@
+#include "clock.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// how far from a whole number of refreshes an interval may be and still
+// be snapped to it
+constexpr double snap_tolerance = 0.25;
+// weight of the newest interval in the running average
+constexpr int average_weight = 8;
+// fraction of the distance to the measured time caught up per frame
+constexpr int drift_correction = 16;
+
+}  // namespace
+
+Clock::Clock()
+    : start_(std::chrono::steady_clock::now()) {}
+
+Nanos Clock::now() const {
+  return std::chrono::steady_clock::now() - start_;
+}
+
+uint64_t Clock::micros() const { return toMicros(now()); }
+
+void FrameStats::add(Nanos dt) {
+  double ms = dt.count() / 1e6;
+  ++frames;
+  sum_ms += ms;
+  sum_sq_ms += ms * ms;
+}
+
+double FrameStats::mean() const { return frames ? sum_ms / frames : 0; }
+
+double FrameStats::jitter() const {
+  if (!frames) {
+    return 0;
+  }
+  double mean = this->mean();
+  return std::sqrt(std::max(sum_sq_ms / frames - mean * mean, 0.));
+}
+
+FramePacer::FramePacer(Nanos refresh, Nanos max_dt)
+    : refresh_(refresh)
+    , max_dt_(max_dt)
+    , average_(refresh) {}
+
+void FramePacer::setRefresh(Nanos refresh) {
+  refresh_ = refresh;
+  average_ = refresh;
+}
+
+Nanos FramePacer::frame(Nanos now) {
+  if (last_measured_ < Nanos(0)) {
+    last_measured_ = now;
+    shown_time_ = now;
+    return now;
+  }
+  Nanos measured = std::clamp(now - last_measured_, Nanos(0), max_dt_);
+  last_measured_ = now;
+  measured_.add(measured);
+
+  Nanos dt;
+  int64_t refreshes = std::llround(double(measured.count()) / refresh_.count());
+  if (refreshes > 0 &&
+      std::abs(measured.count() - refreshes * refresh_.count()) <
+          refresh_.count() * snap_tolerance) {
+    dt = refreshes * refresh_;
+  } else {
+    average_ += (measured - average_) / average_weight;
+    dt = average_;
+  }
+
+  Nanos drift = now - (shown_time_ + dt);
+  if (drift > max_dt_ || drift < -max_dt_) {
+    // e.g. the window was dragged: start over from the measured time
+    dt = std::max(now - shown_time_, Nanos(0));
+  } else {
+    dt = std::max(dt + drift / drift_correction, Nanos(0));
+  }
+  shown_time_ += dt;
+  dt_ = dt;
+  shown_.add(dt);
+  return shown_time_;
+}
+
+Nanos FramePacer::dt() const { return dt_; }
+
+const FrameStats& FramePacer::measured() const { return measured_; }
+
+const FrameStats& FramePacer::shown() const { return shown_; }
+
+void FramePacer::resetStats() {
+  measured_ = {};
+  shown_ = {};
+}
@@ -0,0 +1,72 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+using Nanos = std::chrono::nanoseconds;
+
+// Monotonic time since construction, in nanoseconds, from
+// std::chrono::steady_clock.
+class Clock
+{
+ public:
+  Clock();
+
+  Nanos now() const;
+  uint64_t micros() const;
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+constexpr uint64_t toMicros(Nanos time) {
+  return time.count() > 0 ? time.count() / 1000 : 0;
+}
+
+// Mean and spread of frame intervals, in milliseconds.
+struct FrameStats {
+  uint64_t frames = 0;
+  double sum_ms = 0;
+  double sum_sq_ms = 0;
+
+  void add(Nanos dt);
+  double mean() const;
+  double jitter() const;  // standard deviation
+};
+
+// Turns the measured times of presented frames into the times they show.
+// Measurements jitter with wake ups and event handling although vsync
+// presents frames a whole number of refreshes apart, and stepping by them
+// makes motion shake. So a frame interval within a quarter refresh of a
+// whole number of refreshes is taken as exactly that, others are averaged,
+// spikes are clamped, and the shown time is pulled gently towards the
+// measured one so that the two never drift apart.
+class FramePacer
+{
+ public:
+  FramePacer(Nanos refresh, Nanos max_dt);
+
+  void setRefresh(Nanos refresh);
+  // Time to show for a frame measured at `now`, never going backwards.
+  Nanos frame(Nanos now);
+  // Shown interval before the last frame.
+  Nanos dt() const;
+
+  // Measured and shown intervals since the last reset.
+  const FrameStats& measured() const;
+  const FrameStats& shown() const;
+  void resetStats();
+
+ private:
+  Nanos refresh_;
+  Nanos max_dt_;
+  Nanos average_;
+  Nanos last_measured_{-1};
+  Nanos shown_time_{0};
+  Nanos dt_{0};
+  FrameStats measured_;
+  FrameStats shown_;
+};
+
+#endif  // CLOCK_H
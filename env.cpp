@@ -0,0 +1,203 @@
+#include "env.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "game.h"
+#include "replay.h"
+#include "thread_pool.h"
+
+constexpr float observation_window = 0.5;
+constexpr float envelope_sample_step = 0.1;
+constexpr float cannon_cooldown_max = 70;
+constexpr float ray_length = 0.5;
+
+struct HssEnv {
+  std::vector<std::unique_ptr<Game>> games;
+  std::vector<float> observations;
+  std::vector<float> rewards;
+  std::vector<uint8_t> dones;
+  std::vector<int> restart_seeds;
+  // one per game, as games are observed on the pool's threads
+  std::vector<RaycastScratch> ray_scratch;
+  int next_seed;
+  uint32_t tick_ms = default_tick_ms;
+  ThreadPool pool;
+
+  HssEnv(size_t count, int seed, size_t threads)
+      : games(count)
+      , observations(count * HSS_ENV_OBSERVATION_FLOATS)
+      , rewards(count)
+      , dones(count)
+      , restart_seeds(count)
+      , ray_scratch(count)
+      , next_seed(seed)
+      , pool(threads) {}
+};
+
+namespace {
+
+void startGame(HssEnv* env, size_t i, int seed) {
+  env->games[i] = std::make_unique<Game>(seed);
+  env->games[i]->started = true;
+}
+
+struct Rays {
+  float dx[HSS_ENV_RAYS];
+  float dy[HSS_ENV_RAYS];
+
+  Rays() {
+    for (int i = 0; i < HSS_ENV_RAYS; ++i) {
+      dx[i] = cosf(2 * M_PI * i / HSS_ENV_RAYS);
+      dy[i] = sinf(2 * M_PI * i / HSS_ENV_RAYS);
+    }
+  }
+};
+
+const Rays rays;
+
+void observe(const Game& game, RaycastScratch& scratch, float* out) {
+  const Ship& ship = game.ship;
+  *out++ = ship.x - game.offsetx;
+  *out++ = ship.y;
+  *out++ = ship.vx;
+  *out++ = ship.vy;
+  *out++ = static_cast<float>(ship.health) / ship_max_health;
+  *out++ = ship.multiplier;
+  *out++ = ship.cannon_cooldown / cannon_cooldown_max;
+
+  struct Near {
+    float sqdist;
+    const Boulder* boulder;
+  };
+  Near near[HSS_ENV_BOULDERS];
+  size_t found = 0;
+  auto last = game.cave.boulders.upper_bound(ship.x + observation_window);
+  for (auto it = game.cave.boulders.lower_bound(ship.x - observation_window);
+       it != last; ++it) {
+    const Boulder& boulder = it->second;
+    if (boulder.dead) {
+      continue;
+    }
+    Near candidate = {sqdist(ship.x, ship.y, boulder.x, boulder.y), &boulder};
+    if (found < HSS_ENV_BOULDERS) {
+      near[found++] = candidate;
+    } else if (candidate.sqdist < near[found - 1].sqdist) {
+      near[found - 1] = candidate;
+    } else {
+      continue;
+    }
+    // keep the list sorted with a single insertion step
+    for (size_t j = found - 1; j > 0 && near[j].sqdist < near[j - 1].sqdist;
+         --j) {
+      std::swap(near[j], near[j - 1]);
+    }
+  }
+  for (size_t j = 0; j < HSS_ENV_BOULDERS; ++j) {
+    bool present = j < found;
+    *out++ = present ? near[j].boulder->x - ship.x : 0.f;
+    *out++ = present ? near[j].boulder->y - ship.y : 0.f;
+    *out++ = present ? near[j].boulder->r : 0.f;
+  }
+
+  const Spit* spits[HSS_ENV_SPITS];
+  size_t spit_count = 0;
+  for (const auto& spit : game.cave.spits) {
+    if (spit.dead) {
+      continue;
+    }
+    if (spit_count < HSS_ENV_SPITS) {
+      spits[spit_count++] = &spit;
+      continue;
+    }
+    auto furthest = std::max_element(
+        spits, spits + spit_count, [&](const Spit* a, const Spit* b) {
+          return sqdist(a->x, a->y, ship.x, ship.y) <
+                 sqdist(b->x, b->y, ship.x, ship.y);
+        });
+    if (sqdist(spit.x, spit.y, ship.x, ship.y) <
+        sqdist((*furthest)->x, (*furthest)->y, ship.x, ship.y)) {
+      *furthest = &spit;
+    }
+  }
+  for (size_t j = 0; j < HSS_ENV_SPITS; ++j) {
+    bool present = j < spit_count;
+    *out++ = present ? spits[j]->x - ship.x : 0.f;
+    *out++ = present ? spits[j]->y - ship.y : 0.f;
+    *out++ = present ? spits[j]->vx : 0.f;
+    *out++ = present ? spits[j]->vy : 0.f;
+  }
+
+  for (int j = 0; j < HSS_ENV_ENVELOPE_SAMPLES; ++j) {
+    auto it = game.cave.floor_envelope.lower_bound(ship.x +
+                                                   j * envelope_sample_step);
+    *out++ = it != game.cave.floor_envelope.end() ? it->second : 1.f;
+  }
+
+  game.cave.raycast(ship.x, ship.y, rays.dx, rays.dy, HSS_ENV_RAYS, ray_length,
+                    out, scratch);
+}
+
+}  // namespace
+
+extern "C" {
+
+HssEnv* hss_env_create(size_t count, int seed, size_t threads) {
+  HssEnv* env = new HssEnv(count, seed, threads);
+  hss_env_reset(env);
+  return env;
+}
+
+void hss_env_destroy(HssEnv* env) { delete env; }
+
+size_t hss_env_count(const HssEnv* env) { return env->games.size(); }
+
+uint32_t hss_env_tick_ms(const HssEnv* env) { return env->tick_ms; }
+
+void hss_env_reset(HssEnv* env) {
+  int first_seed = env->next_seed;
+  env->next_seed += env->games.size();
+  env->pool.parallelFor(env->games.size(), [&](size_t i) {
+    startGame(env, i, first_seed + i);
+    observe(*env->games[i], env->ray_scratch[i],
+            &env->observations[i * HSS_ENV_OBSERVATION_FLOATS]);
+    env->rewards[i] = 0;
+    env->dones[i] = 0;
+  });
+}
+
+void hss_env_step(HssEnv* env, const uint8_t* commands) {
+  env->pool.parallelFor(env->games.size(), [&](size_t i) {
+    Game& game = *env->games[i];
+    int64_t score = game.score;
+    game.step(commands[i], env->tick_ms);
+    env->rewards[i] = game.score - score;
+    env->dones[i] = game.gameover;
+  });
+
+  // seeds are handed out in game order so that runs are reproducible
+  for (size_t i = 0; i < env->games.size(); ++i) {
+    if (env->dones[i]) {
+      env->restart_seeds[i] = env->next_seed++;
+    }
+  }
+
+  env->pool.parallelFor(env->games.size(), [&](size_t i) {
+    if (env->dones[i]) {
+      startGame(env, i, env->restart_seeds[i]);
+    }
+    observe(*env->games[i], env->ray_scratch[i],
+            &env->observations[i * HSS_ENV_OBSERVATION_FLOATS]);
+  });
+}
+
+const float* hss_env_observations(const HssEnv* env) {
+  return env->observations.data();
+}
+
+const float* hss_env_rewards(const HssEnv* env) { return env->rewards.data(); }
+
+const uint8_t* hss_env_dones(const HssEnv* env) { return env->dones.data(); }
+}
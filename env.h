@@ -0,0 +1,60 @@
+#ifndef ENV_H
+#define ENV_H
+
+/* Plain C interface over a batch of games for learning agents. Buffers
+ * returned by the accessors stay valid and at the same address for the
+ * life of the environment, so they can be mapped without copying. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Observation layout, in floats per game:
+ *   ship: x relative to the screen, y, vx, vy, health fraction, multiplier,
+ *         cannon cooldown fraction
+ *   nearest boulders: dx, dy, r (zero padded)
+ *   nearest spits: dx, dy, vx, vy (zero padded)
+ *   floor envelope height every 0.1 units ahead of the ship (1 if none)
+ *   distance to the first boulder or floor hit along rays cast evenly
+ *   around the ship, starting straight ahead, capped at 0.5 */
+#define HSS_ENV_SHIP_FLOATS 7
+#define HSS_ENV_BOULDERS 8
+#define HSS_ENV_SPITS 8
+#define HSS_ENV_ENVELOPE_SAMPLES 16
+#define HSS_ENV_RAYS 16
+#define HSS_ENV_OBSERVATION_FLOATS                                  \
+  (HSS_ENV_SHIP_FLOATS + 3 * HSS_ENV_BOULDERS + 4 * HSS_ENV_SPITS + \
+   HSS_ENV_ENVELOPE_SAMPLES + HSS_ENV_RAYS)
+
+typedef struct HssEnv HssEnv;
+
+/* Games are seeded seed, seed + 1, ... and step on `threads` threads. */
+HssEnv* hss_env_create(size_t count, int seed, size_t threads);
+void hss_env_destroy(HssEnv* env);
+
+size_t hss_env_count(const HssEnv* env);
+uint32_t hss_env_tick_ms(const HssEnv* env);
+
+/* Restarts every game with fresh seeds and refreshes the observations. */
+void hss_env_reset(HssEnv* env);
+
+/* Applies one command bitmask per game (bit i is Command i) and advances
+ * every game by one tick. A game whose ship died reports done and is
+ * restarted with the next unused seed; its observation is the new game's. */
+void hss_env_step(HssEnv* env, const uint8_t* commands);
+
+/* count * HSS_ENV_OBSERVATION_FLOATS floats, game after game */
+const float* hss_env_observations(const HssEnv* env);
+/* count score deltas of the last step */
+const float* hss_env_rewards(const HssEnv* env);
+/* count flags, 1 where the last step ended the game */
+const uint8_t* hss_env_dones(const HssEnv* env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ENV_H */
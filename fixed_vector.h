@@ -0,0 +1,55 @@
+#ifndef FIXED_VECTOR_H
+#define FIXED_VECTOR_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+
+// Vector with inline storage for at most N elements. Trivially copyable
+// when T is, so that it can live in flat, memcpy-able world state.
+template <typename T, size_t N>
+class FixedVector
+{
+ public:
+  FixedVector() = default;
+  FixedVector(std::initializer_list<T> values) {
+    for (const T& value : values) {
+      push_back(value);
+    }
+  }
+
+  void push_back(const T& value) { items_[size_++] = value; }
+  void clear() { size_ = 0; }
+
+  T& operator[](size_t i) { return items_[i]; }
+  const T& operator[](size_t i) const { return items_[i]; }
+  T& front() { return items_[0]; }
+  const T& front() const { return items_[0]; }
+  T& back() { return items_[size_ - 1]; }
+  const T& back() const { return items_[size_ - 1]; }
+
+  T* begin() { return items_.data(); }
+  T* end() { return items_.data() + size_; }
+  const T* begin() const { return items_.data(); }
+  const T* end() const { return items_.data() + size_; }
+  std::reverse_iterator<const T*> rbegin() const {
+    return std::reverse_iterator<const T*>(end());
+  }
+  std::reverse_iterator<const T*> rend() const {
+    return std::reverse_iterator<const T*>(begin());
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  std::array<T, N> items_{};
+  uint8_t size_ = 0;
+
+  static_assert(N <= UINT8_MAX);
+};
+
+#endif  // FIXED_VECTOR_H
@@ -0,0 +1,128 @@
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Ordered map stored as a sorted vector. The world scrolls left to right,
+// so inserts land near the back and evictions erase from the front; front
+// erasure only advances an offset and the storage is compacted once the
+// dead prefix outgrows the live part.
+template <typename K, typename V>
+class FlatMap
+{
+ public:
+  struct Entry {
+    K first;
+    V second;
+  };
+
+  using iterator = typename std::vector<Entry>::iterator;
+  using const_iterator = typename std::vector<Entry>::const_iterator;
+
+ public:
+  iterator begin() { return entries_.begin() + head_; }
+  iterator end() { return entries_.end(); }
+  const_iterator begin() const { return entries_.begin() + head_; }
+  const_iterator end() const { return entries_.end(); }
+
+  size_t size() const { return entries_.size() - head_; }
+  bool empty() const { return size() == 0; }
+  size_t capacity() const { return entries_.capacity(); }
+
+  void clear() {
+    entries_.clear();
+    head_ = 0;
+  }
+
+  // Replaces the contents with `count` default entries, e.g. to be filled in
+  // order by a snapshot restore.
+  void resize(size_t count) {
+    clear();
+    entries_.resize(count);
+  }
+
+  Entry* data() { return entries_.data() + head_; }
+  const Entry* data() const { return entries_.data() + head_; }
+
+  iterator lower_bound(const K& key) {
+    return std::lower_bound(begin(), end(), key, [](const Entry& e, const K& k) {
+      return e.first < k;
+    });
+  }
+  const_iterator lower_bound(const K& key) const {
+    return std::lower_bound(begin(), end(), key, [](const Entry& e, const K& k) {
+      return e.first < k;
+    });
+  }
+  iterator upper_bound(const K& key) {
+    return std::upper_bound(begin(), end(), key, [](const K& k, const Entry& e) {
+      return k < e.first;
+    });
+  }
+  const_iterator upper_bound(const K& key) const {
+    return std::upper_bound(begin(), end(), key, [](const K& k, const Entry& e) {
+      return k < e.first;
+    });
+  }
+
+  iterator find(const K& key) {
+    iterator it = lower_bound(key);
+    return it != end() && !(key < it->first) ? it : end();
+  }
+  const_iterator find(const K& key) const {
+    const_iterator it = lower_bound(key);
+    return it != end() && !(key < it->first) ? it : end();
+  }
+  size_t count(const K& key) const { return find(key) != end(); }
+
+  // Inserts unless the key is already present, like std::map::emplace.
+  std::pair<iterator, bool> emplace(const K& key, const V& value) {
+    iterator it = lower_bound(key);
+    if (it != end() && !(key < it->first)) {
+      return {it, false};
+    }
+    return {entries_.insert(it, {key, value}), true};
+  }
+
+  V& operator[](const K& key) {
+    iterator it = lower_bound(key);
+    if (it == end() || key < it->first) {
+      it = entries_.insert(it, {key, V()});
+    }
+    return it->second;
+  }
+
+  // Gives back storage beyond `capacity` entries, no fewer than the size,
+  // e.g. after a spike. Drops the erased prefix.
+  void shrink(size_t capacity) {
+    if (capacity >= entries_.capacity()) {
+      return;
+    }
+    std::vector<Entry> entries;
+    entries.reserve(capacity);
+    entries.assign(begin(), end());
+    entries_.swap(entries);
+    head_ = 0;
+  }
+
+  iterator erase(iterator first, iterator last) {
+    if (first != begin()) {
+      return entries_.erase(first, last);
+    }
+    head_ += last - first;
+    if (head_ > entries_.size() / 2) {
+      entries_.erase(entries_.begin(), entries_.begin() + head_);
+      head_ = 0;
+    }
+    return begin();
+  }
+
+ private:
+  std::vector<Entry> entries_;
+  size_t head_ = 0;
+};
+
+#endif  // FLAT_MAP_H
@@ -1,5 +1,10 @@
 #include "game.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "alloc_tracker.h"
 #include "util.h"
 
 constexpr float vertical_thrust = 0.6;
@@ -18,24 +23,67 @@ constexpr int bullet_damage = 100;
 
 constexpr float gravity = 2.91;
 
-Game::Game()
-    : ship()
-    , time_(0) {
-  ship.x = 0.1;
+// generated ahead of the screen's left edge at the start and while playing
+constexpr float initial_generation = 1.8;
+constexpr float generation_lookahead = 2.0;
+// screen width plus the largest boulder radius
+constexpr float generation_deadline = 1.92;
+// positions are rebased once the screen is this far from the origin
+constexpr float rebase_distance = 64;
+
+// boulders the ship can touch at once, reserved so that ticks don't allocate
+constexpr size_t max_collisions = 16;
+
+constexpr float collapse_speed = 1.5;
+constexpr int collapse_budget = 24;
+
+Game::Game(int seed, double startx)
+    : cave(seed)
+    , ship()
+    , time_(0)
+    , generator_(seed) {
+  cave.rebase(static_cast<int64_t>(std::floor(startx / chunk_width)));
+  offsetx = startx - cave.worldX(0);
+  ship.x = offsetx + 0.1;
   ship.y = 0.5;
   ship.r = 0.0125;
   ship.multiplier = 1.0;
   ship.speed = 0.5;
   ship.health = ship_max_health;
-  last_gen = 1.8f;
-  cave.generate(0.f, last_gen);
+  collisions.reserve(max_collisions);
+  // include the chunk whose boulders reach into the screen from the left
+  next_chunk_ =
+      std::max<int64_t>(cave.chunkAt(offsetx - boulder_max_radius), 0);
+  while (cave.chunkStart(next_chunk_) - offsetx < initial_generation) {
+    cave.generateChunk(next_chunk_++);
+  }
+}
+
+void Game::step(CommandMask commands, uint32_t dt) {
+  step(commands, std::chrono::milliseconds(dt));
 }
 
-void Game::commands(const std::unordered_set<Command>& commands) {
-  if (commands.count(Command::THRUST_UP)) {
+void Game::step(CommandMask commands, std::chrono::nanoseconds dt) {
+  if (!gameover) {
+    this->commands(commands);
+  }
+  update(dt);
+}
+
+void Game::commands(CommandMask commands) {
+  auto down = [commands](Command command) {
+    return (commands & commandBit(command)) != 0;
+  };
+
+  if (down(Command::GIVE_UP)) {
+    ship.health = 0;
+    last_damage_ = DeathCause::GIVE_UP;
+  }
+
+  if (down(Command::THRUST_UP)) {
     ship.vy -= vertical_thrust;
     ship.vy = std::max(ship.vy, -vertical_thrust_max);
-  } else if (commands.count(Command::THRUST_DOWN)) {
+  } else if (down(Command::THRUST_DOWN)) {
     ship.vy += vertical_thrust;
     ship.vy = std::min(ship.vy, vertical_thrust_max);
   } else {
@@ -46,10 +94,10 @@ void Game::commands(const std::unordered_set<Command>& commands) {
     }
   }
 
-  if (commands.count(Command::THRUST_BACKWARD)) {
+  if (down(Command::THRUST_BACKWARD)) {
     ship.vx -= horizontal_thrust;
     ship.vx = std::max(ship.vx, -horizontal_thrust_max);
-  } else if (commands.count(Command::THRUST_FORWARD)) {
+  } else if (down(Command::THRUST_FORWARD)) {
     ship.vx += vertical_thrust;
     ship.vx = std::min(ship.vx, horizontal_thrust_max);
   } else {
@@ -60,7 +108,7 @@ void Game::commands(const std::unordered_set<Command>& commands) {
     }
   }
 
-  if (ship.cannon_cooldown == 0 && commands.count(Command::FIRE)) {
+  if (ship.cannon_cooldown == 0 && down(Command::FIRE)) {
     cave.bullets.push_back({.x = ship.x,
                             .y = ship.y,
                             .vx = cosf(bullet_angle),
@@ -81,18 +129,147 @@ void Game::commands(const std::unordered_set<Command>& commands) {
   }
 };
 
+namespace {
+
+constexpr uint64_t game_layout =
+    snapshotLayout<FlatMap<float, Boulder>::Entry, FlatMap<float, float>::Entry,
+                   Spider, Bullet, Spit, Debris, BackgroundLine,
+                   GenerationStats, GenerationJob, Hasher, Ship, MemoryLimits,
+                   CollapseTarget, std::default_random_engine>();
+
+}  // namespace
+
+void Game::snapshot(Snapshot& snapshot) const {
+  SnapshotWriter writer(snapshot, game_layout);
+  cave.save(writer);
+  writer.write(offsetx);
+  writer.write(offsety);
+  writer.write(ship);
+  writer.writeRange(collisions);
+  writer.write(started);
+  writer.write(gameover);
+  writer.write(invulnerable);
+  writer.write(score);
+  writer.write(death_cause);
+  writer.write(generation_budget);
+  writer.write(memory_limits);
+  writer.write(time_);
+  writer.write(next_chunk_);
+  writer.write(gameover_countdown);
+  writer.write(gameover_slowdown);
+  writer.write(bullet_angle);
+  writer.write(bullet_angle_delta);
+  writer.writeRange(collapse_queue_);
+  writer.write(collapse_radius_);
+  writer.write(collapsing_);
+  writer.write(last_damage_);
+  writer.write(generator_);
+}
+
+StateHash Game::stateHash() const {
+  StateHash hash;
+  cave.hashState(hash);
+
+  Hasher hasher;
+  hasher.add(offsetx);
+  hasher.add(offsety);
+  hasher.add(static_cast<uint64_t>(collisions.size()));
+  for (const Boulder& boulder : collisions) {
+    hasher.add(boulder.x);
+  }
+  hasher.add(started);
+  hasher.add(gameover);
+  hasher.add(invulnerable);
+  hasher.add(score);
+  hasher.add(death_cause);
+  hasher.add(generation_budget);
+  for (size_t limit : memory_limits.bytes) {
+    hasher.add(static_cast<uint64_t>(limit));
+  }
+  hasher.add(time_);
+  hasher.add(next_chunk_);
+  hasher.add(gameover_countdown);
+  hasher.add(gameover_slowdown);
+  hasher.add(bullet_angle);
+  hasher.add(bullet_angle_delta);
+  hasher.add(static_cast<uint64_t>(collapse_queue_.size()));
+  for (const CollapseTarget& target : collapse_queue_) {
+    hasher.add(target.sqdist);
+    hasher.add(target.x);
+  }
+  hasher.add(collapse_radius_);
+  hasher.add(collapsing_);
+  hasher.add(last_damage_);
+  hash[StateSection::GAME] = hasher.value();
+
+  hasher = {};
+  hasher.add(ship.x);
+  hasher.add(ship.y);
+  hasher.add(ship.vx);
+  hasher.add(ship.vy);
+  hasher.add(ship.r);
+  hasher.add(ship.multiplier);
+  hasher.add(ship.speed);
+  hasher.add(ship.cannon_cooldown);
+  hasher.add(ship.health);
+  hasher.add(ship.damaged_cooldown);
+  hash[StateSection::SHIP] = hasher.value();
+
+  hasher = {};
+  hasher.add(hash[StateSection::RANDOM]);
+  hasher.addBytes(generator_);
+  hash[StateSection::RANDOM] = hasher.value();
+  return hash;
+}
+
+bool Game::restore(const Snapshot& snapshot) {
+  SnapshotReader reader(snapshot, game_layout);
+  if (!reader.ok()) {
+    return false;
+  }
+  cave.restore(reader);
+  reader.read(offsetx);
+  reader.read(offsety);
+  reader.read(ship);
+  reader.readRange(collisions);
+  reader.read(started);
+  reader.read(gameover);
+  reader.read(invulnerable);
+  reader.read(score);
+  reader.read(death_cause);
+  reader.read(generation_budget);
+  reader.read(memory_limits);
+  reader.read(time_);
+  reader.read(next_chunk_);
+  reader.read(gameover_countdown);
+  reader.read(gameover_slowdown);
+  reader.read(bullet_angle);
+  reader.read(bullet_angle_delta);
+  reader.readRange(collapse_queue_);
+  reader.read(collapse_radius_);
+  reader.read(collapsing_);
+  reader.read(last_damage_);
+  reader.read(generator_);
+  return reader.done();
+}
+
 void Game::checkCollisions() {
+  TickCounters& counters = cave.counters;
   collisions.clear();
   for (auto it = cave.boulders.lower_bound(ship.x - 0.1);
        it != cave.boulders.upper_bound(ship.x + 0.1); ++it) {
+    ++counters.map_nodes_visited;
     if (it->second.dead) {
       continue;
     }
+    ++counters.collision_candidates;
     if ((ship.x - it->second.x) * (ship.x - it->second.x) +
-            (ship.y - it->second.y) * (ship.y - it->second.y) <
-        (ship.r + it->second.r) * (ship.r + it->second.r)) {
+                (ship.y - it->second.y) * (ship.y - it->second.y) <
+            (ship.r + it->second.r) * (ship.r + it->second.r) &&
+        boulderHit(it->second, ship.x, ship.y, ship.r)) {
       collisions.push_back(it->second);
       it->second.dead = true;
+      ++counters.collision_hits;
     }
   }
 
@@ -103,28 +280,82 @@ void Game::checkCollisions() {
     }
     for (auto it = cave.boulders.lower_bound(bullet.x - 0.1);
          it != cave.boulders.upper_bound(bullet.x + 0.1); ++it) {
+      ++counters.map_nodes_visited;
       auto& boulder = it->second;
       if (boulder.dead) {
         continue;
       }
+      ++counters.collision_candidates;
       if ((bullet.x - boulder.x) * (bullet.x - boulder.x) +
-              (bullet.y - boulder.y) * (bullet.y - boulder.y) <
-          (boulder.r) * (boulder.r)) {
+                  (bullet.y - boulder.y) * (bullet.y - boulder.y) <
+              (boulder.r) * (boulder.r) &&
+          boulderHit(boulder, bullet.x, bullet.y, 0.f)) {
         bullet.dead = true;
         boulder.damaged_cooldown = 50;
         boulder.health -= bullet.damage * ship.multiplier;
         score += 50 * boulder.r * ship.multiplier;
+        ++counters.collision_hits;
       }
     }
   }
 }
 
-void Game::update(uint32_t dt) {
-  static std::uniform_real_distribution<float> d_angle(0, M_PI * 2);
+// The cave collapses in a wave spreading out from the ship, exploding at
+// most collapse_budget boulders per tick so that frame time stays flat.
+void Game::collapse(float dts) {
+  collapse_radius_ += collapse_speed * dts;
+  int budget = collapse_budget;
+  while (!collapse_queue_.empty() && budget > 0 &&
+         collapse_queue_.back().sqdist <=
+             collapse_radius_ * collapse_radius_) {
+    auto it = cave.boulders.find(collapse_queue_.back().x);
+    collapse_queue_.pop_back();
+    if (it != cave.boulders.end() && !it->second.dead) {
+      it->second.dead = true;
+      cave.explodeBoulder(it->second);
+      --budget;
+    }
+  }
+
+  if (collapse_queue_.empty()) {
+    cave.boulders.clear();
+    collapsing_ = false;
+  }
+}
+
+double Game::distance() const { return cave.worldX(offsetx); }
+
+// Shifts the origin to the chunk the screen is in, so that positions stay
+// small and float precision constant however long the run.
+void Game::rebase() {
+  int64_t chunks = cave.chunkAt(offsetx) - cave.origin();
+  const float shift = chunks * chunk_width;
+  cave.rebase(chunks);
+  offsetx -= shift;
+  ship.x -= shift;
+  for (auto& boulder : collisions) {
+    boulder.x -= shift;
+  }
+  for (auto& target : collapse_queue_) {
+    target.x -= shift;
+  }
+}
+
+void Game::update(uint32_t dt) { update(std::chrono::milliseconds(dt)); }
+
+void Game::update(std::chrono::nanoseconds dt) {
+  AllocationScope scope(Subsystem::SIMULATION);
+  cave.counters = {};
   if (!started) {
     return;
   }
-  const float dts = std::min(dt / 1000.f, 1.f);
+  if (offsetx >= rebase_distance) {
+    rebase();
+  }
+  // whole milliseconds give the same floats as before, so replays match
+  const float dts = std::min(dt.count() / 1e9f, 1.f);
+  const float dt_ms = dt.count() / 1e6f;
+  const int32_t whole_ms = dt / std::chrono::milliseconds(1);
   const float offset = dts * ship.speed * gameover_slowdown * ship.multiplier;
 
   ship.y += ship.vy * vertical_speed * dts;
@@ -140,14 +371,20 @@ void Game::update(uint32_t dt) {
   }
   ship.y = std::min(std::max(ship.y, 0.f), 1.f);
 
-  if (last_gen - offsetx <= 2.0) {
-    float next_gen = offsetx + 2.2;
-    cave.generate(last_gen, next_gen);
-    last_gen = next_gen;
+  if (!cave.generating() &&
+      cave.chunkStart(next_chunk_) - offsetx <= generation_lookahead) {
+    cave.beginChunk(next_chunk_++);
+  }
+  if (cave.generating()) {
+    // a chunk has to be complete by the time it scrolls into view
+    bool due = cave.generationStart() - offsetx <= generation_deadline;
+    cave.generateStep(due || generation_budget <= 0
+                          ? std::numeric_limits<int>::max()
+                          : generation_budget);
   }
 
   if (ship.cannon_cooldown > 0) {
-    ship.cannon_cooldown = std::max<int32_t>(ship.cannon_cooldown - dt, 0);
+    ship.cannon_cooldown = std::max<int32_t>(ship.cannon_cooldown - whole_ms, 0);
   }
 
   if (!gameover) {
@@ -171,9 +408,10 @@ void Game::update(uint32_t dt) {
     if (sqdist(spit.x, spit.y, ship.x, ship.y) < ship.r * ship.r) {
       spit.dead = true;
       ship.health -= spit.r * 2000;
+      last_damage_ = DeathCause::SPIT;
       ship.damaged_cooldown = 50;
 
-      float theta = d_angle(generator_);
+      float theta = d_angle_(generator_);
       std::array<Point, 2> vertices = {
           {{cosf(theta - 0.1f) * 0.02f, sinf(theta - 0.1f) * 0.02f},
            {cosf(theta + 0.1f) * 0.02f, sinf(theta + 0.1f) * 0.02f}}};
@@ -187,6 +425,7 @@ void Game::update(uint32_t dt) {
           .vertices = vertices,
       };
       cave.debris.push_back(d);
+      ++cave.counters.debris_spawned;
     }
   }
 
@@ -198,7 +437,7 @@ void Game::update(uint32_t dt) {
   for (auto& [x, boulder] : cave.boulders) {
     if (boulder.damaged_cooldown > 0) {
       boulder.damaged_cooldown =
-          std::max<int32_t>(boulder.damaged_cooldown - dt, 0);
+          std::max<int32_t>(boulder.damaged_cooldown - whole_ms, 0);
       if (boulder.health <= 0) {
         boulder.dead = true;
         cave.explodeBoulder(boulder);
@@ -266,8 +505,10 @@ void Game::update(uint32_t dt) {
     debris.x += (debris.vx) * dts;
     debris.y += (debris.vy) * dts;
     debris.vy += gravity * dts;
+    debris.ttl -= dts;
 
-    if (debris.x < offsetx - 0.1 || debris.y > 1.1 || debris.y < -0.1) {
+    if (debris.x < offsetx - 0.1 || debris.y > 1.1 || debris.y < -0.1 ||
+        debris.ttl <= 0) {
       debris.dead = true;
     }
   }
@@ -284,26 +525,41 @@ void Game::update(uint32_t dt) {
   while (!cave.debris.empty() && cave.debris.front().dead) {
     cave.debris.pop_front();
   }
-  while ((cave.background.size() > 1) &&
-         cave.background.front().vertices.front().x < -0.5) {
+  // the background scrolls 1.1 times as fast; a line goes once the polygon
+  // it starts has scrolled out on the left
+  auto rightmost = [](const BackgroundLine& line) {
+    float x = line.vertices.front().x;
+    for (const Point& vertex : line.vertices) {
+      x = std::max(x, vertex.x);
+    }
+    return x;
+  };
+  while (cave.background.size() > 2 &&
+         rightmost(cave.background[1]) < offsetx * 1.1f) {
     cave.background.pop_front();
   }
+  cave.enforceLimits(memory_limits);
 
   checkCollisions();
 
   for (auto& boulder : collisions) {
     ship.health -= 1000 * boulder.r;
+    last_damage_ = DeathCause::BOULDER;
     ship.damaged_cooldown = 100;
     cave.explodeBoulder(boulder);
   }
 
   if (ship.damaged_cooldown > 0) {
-    ship.damaged_cooldown = std::max<int32_t>(ship.damaged_cooldown - dt, 0);
+    ship.damaged_cooldown = std::max<int32_t>(ship.damaged_cooldown - whole_ms, 0);
+    if (ship.health <= 0 && invulnerable) {
+      ship.health = ship_max_health;
+    }
     if (ship.health <= 0) {
       if (!gameover) {
+        death_cause = last_damage_;
         for (int j = 0; j < 50; ++j) {
-          float theta = d_angle(generator_);
-          float size = fabs(d_angle(generator_)) * 0.01;
+          float theta = d_angle_(generator_);
+          float size = fabs(d_angle_(generator_)) * 0.01;
           std::array<Point, 2> vertices = {
               {{cosf(theta - 0.1f) * size, sinf(theta - 0.1f) * size},
                {cosf(theta + 0.1f) * size, sinf(theta + 0.1f) * size}}};
@@ -317,6 +573,7 @@ void Game::update(uint32_t dt) {
               .vertices = vertices,
           };
           cave.debris.push_back(d);
+          ++cave.counters.debris_spawned;
         }
       }
       gameover = true;
@@ -331,16 +588,25 @@ void Game::update(uint32_t dt) {
       gameover_slowdown = std::max(gameover_slowdown - dts, 0.f);
     }
     if (gameover_countdown > 0) {
-      gameover_countdown = std::max<int>(gameover_countdown - dt, 0);
+      gameover_countdown = std::max<int>(gameover_countdown - whole_ms, 0);
     } else if (gameover_countdown == 0) {
+      collapse_queue_.clear();
       for (auto& [x, boulder] : cave.boulders) {
-        boulder.dead = true;
-        cave.explodeBoulder(boulder);
+        if (!boulder.dead) {
+          collapse_queue_.push_back(
+              {sqdist(boulder.x, boulder.y, ship.x, ship.y), x});
+        }
       }
-      cave.boulders.clear();
+      std::sort(collapse_queue_.begin(), collapse_queue_.end(),
+                std::greater<>());
+      collapse_radius_ = 0;
+      collapsing_ = true;
       gameover_countdown = -1;
     }
+    if (collapsing_) {
+      collapse(dts);
+    }
   } else {
-    score += ship.multiplier * ship.multiplier * dt;
+    score += ship.multiplier * ship.multiplier * dt_ms;
   }
 }
@@ -0,0 +1,454 @@
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "alloc_tracker.h"
+#include "batch.h"
+#include "clock.h"
+#include "game.h"
+#include "latency.h"
+#include "perf.h"
+#include "replay.h"
+#include "runahead.h"
+#include "soak.h"
+
+namespace {
+
+void printAllocations(const AllocationCounts (&counts)[subsystem_count]) {
+  for (size_t i = 0; i < subsystem_count; ++i) {
+    printf("%s: %" PRIu64 " allocations, %" PRIu64 " frees, %" PRIu64
+           " bytes\n",
+           subsystemName(static_cast<Subsystem>(i)), counts[i].allocations,
+           counts[i].frees, counts[i].bytes);
+  }
+}
+
+// Plays an invulnerable game, firing in bursts, and fails if any tick past
+// the first half still touches the heap.
+int allocCheck(int seed, double startx, uint64_t ticks) {
+  if (!allocationTrackingEnabled()) {
+    std::cerr << "--alloc-check needs a build with HSS_TRACK_ALLOCATIONS"
+              << std::endl;
+    return 1;
+  }
+  Game game(seed, startx);
+  game.started = true;
+  game.invulnerable = true;
+
+  AllocationCounts before[subsystem_count];
+  uint64_t warmup = ticks / 2;
+  for (uint64_t tick = 1; tick <= ticks; ++tick) {
+    if (tick == warmup + 1) {
+      for (size_t i = 0; i < subsystem_count; ++i) {
+        before[i] = allocationCounts(static_cast<Subsystem>(i));
+      }
+    }
+    CommandMask commands =
+        tick % 40 < 20 ? commandBit(Command::FIRE) : CommandMask(0);
+    game.step(commands, default_tick_ms);
+  }
+
+  AllocationCounts after[subsystem_count];
+  uint64_t allocations = 0;
+  for (size_t i = 0; i < subsystem_count; ++i) {
+    after[i] = allocationCounts(static_cast<Subsystem>(i)) - before[i];
+    allocations += after[i].allocations;
+  }
+  printf("steady state: ticks %" PRIu64 " to %" PRIu64 ", distance %.2f\n",
+         warmup + 1, ticks, game.distance());
+  printAllocations(after);
+  printf("%s\n", allocations ? "FAIL" : "PASS");
+  return allocations ? 1 : 0;
+}
+
+// Plays an invulnerable game in real time for `seconds` with random input
+// and reports how long inputs wait for the tick that simulates them. Frames
+// are 60 Hz and drawing is skipped, so a frame is done once simulated.
+int latencyRun(int seed, double seconds) {
+  Game game(seed);
+  game.started = true;
+  game.invulnerable = true;
+
+  auto start = std::chrono::steady_clock::now();
+  auto micros = [start]() -> uint64_t {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  InputQueue queue;
+  InputTimeline input(queue);
+  LatencyTracker latency;
+  input.track(&latency);
+  InputInjector injector(queue, micros, seed);
+
+  const uint64_t frame_us = 1000000 / 60;
+  const uint64_t tick_us = default_tick_ms * 1000;
+  uint64_t simulated_us = 0;
+  for (uint64_t frame_end_us = frame_us; frame_end_us <= seconds * 1e6;
+       frame_end_us += frame_us) {
+    std::this_thread::sleep_until(start +
+                                  std::chrono::microseconds(frame_end_us));
+    uint64_t now_us = micros();
+    while (now_us - simulated_us >= tick_us) {
+      simulated_us += tick_us;
+      game.step(input.commandsUntil(simulated_us), default_tick_ms);
+      latency.ticked(micros());
+    }
+    latency.presented(micros());
+  }
+
+  printf("%s", latency.report().c_str());
+  printf("injected inputs dropped: %" PRIu64 "\n", injector.dropped());
+  return 0;
+}
+
+// Plays a game one tick per frame, firing in bursts, while predicting 1 to
+// max_ticks ahead, and reports what prediction costs per frame and how
+// often the real game did not reach the state that was shown.
+int runAheadCost(int seed, int max_ticks, uint64_t frames) {
+  const double frame_us = 1e6 / 60;
+  const uint64_t warmup = frames / 10;
+  for (int ticks = 1; ticks <= max_ticks; ++ticks) {
+    Game game(seed);
+    game.started = true;
+    game.invulnerable = true;
+    RunAhead ahead(ticks);
+    // hash of every prediction still to be compared, by frame
+    std::vector<uint64_t> predicted(ticks);
+    uint64_t compared = 0;
+    uint64_t mispredicted = 0;
+    for (uint64_t frame = 0; frame < frames; ++frame) {
+      if (frame == warmup) {
+        ahead.resetCost();
+      }
+      CommandMask commands =
+          frame % 40 < 20 ? commandBit(Command::FIRE) : CommandMask(0);
+      game.step(commands, default_tick_ms);
+      uint64_t& slot = predicted[frame % ticks];
+      if (frame >= warmup + ticks) {
+        ++compared;
+        mispredicted += slot != game.stateHash().combined();
+      }
+      slot = ahead.predict(game, commands, default_tick_ms)
+                 .stateHash()
+                 .combined();
+    }
+    const RunAheadCost& cost = ahead.cost();
+    printf("run-ahead %d: %6.1f us per frame (copy %5.1f us, ticks %6.1f us),"
+           " %4.1f%% of a 60 Hz frame, %4.1f%% mispredicted\n",
+           ticks, cost.frameUs(), cost.copy_ns / cost.frames / 1000,
+           cost.step_ns / cost.frames / 1000,
+           cost.frameUs() / frame_us * 100,
+           compared ? 100. * mispredicted / compared : 0.);
+  }
+  return 0;
+}
+
+// Feeds the frame pacer a minute of frames presented by vsync at `hz` but
+// measured late by up to a millisecond of wake up, with an occasional
+// missed refresh and a rare stall, and reports how evenly spaced the shown
+// times are against the measured ones.
+int pacingRun(int seed, double hz) {
+  const Nanos refresh(static_cast<int64_t>(1e9 / hz));
+  FramePacer pacer(refresh, std::chrono::milliseconds(250));
+  std::default_random_engine generator(seed);
+  std::uniform_int_distribution<int64_t> d_wakeup{0, 1000000};
+  std::uniform_real_distribution<double> d_unit{0, 1};
+
+  // offsets from the refresh a frame was presented at
+  FrameStats measured_offset;
+  FrameStats shown_offset;
+  Nanos vsync{0};
+  for (uint64_t frame = 0; frame < 60 * hz; ++frame) {
+    double event = d_unit(generator);
+    vsync += event < 0.001 ? refresh * 7 : event < 0.01 ? refresh * 2 : refresh;
+    Nanos measured = vsync + Nanos(d_wakeup(generator));
+    Nanos shown = pacer.frame(measured);
+    if (frame > 0) {
+      measured_offset.add(measured - vsync);
+      shown_offset.add(shown - vsync);
+    }
+  }
+
+  const FrameStats& measured = pacer.measured();
+  const FrameStats& shown = pacer.shown();
+  printf("refresh: %.3f ms\n", refresh.count() / 1e6);
+  printf("measured frames: mean %.3f ms, jitter %.3f ms\n", measured.mean(),
+         measured.jitter());
+  printf("shown frames:    mean %.3f ms, jitter %.3f ms\n", shown.mean(),
+         shown.jitter());
+  printf("offset from vsync: measured %.3f +- %.3f ms, shown %.3f +- %.3f ms\n",
+         measured_offset.mean(), measured_offset.jitter(),
+         shown_offset.mean(), shown_offset.jitter());
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string replay_path;
+  std::string counters_path;
+  std::string record_path;
+  std::string perf_path;
+  std::vector<std::string> perf_replays;
+  bool perf_update = false;
+  int seed = 0;
+  double startx = 0;
+  uint32_t ticks = 10000;
+  uint64_t alloc_check_ticks = 0;
+  size_t batch = 0;
+  double soak_hours = 0;
+  double latency_seconds = 0;
+  int run_ahead_ticks = 0;
+  double pacing_hz = 0;
+  uint32_t sample_ticks = SoakConfig().sample_ticks;
+  MemoryLimits memory_limits;
+  size_t threads = std::thread::hardware_concurrency();
+  Policy policy = Policy::RANDOM;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--perf" && i + 1 < argc) {
+      perf_path = argv[++i];
+    } else if (arg == "--perf-replay" && i + 1 < argc) {
+      perf_replays.push_back(argv[++i]);
+    } else if (arg == "--perf-update") {
+      perf_update = true;
+    } else if (arg == "--alloc-check" && i + 1 < argc) {
+      alloc_check_ticks = std::stoull(argv[++i]);
+    } else if (arg == "--pacing" && i + 1 < argc) {
+      pacing_hz = std::stod(argv[++i]);
+    } else if (arg == "--run-ahead" && i + 1 < argc) {
+      run_ahead_ticks = std::stoi(argv[++i]);
+    } else if (arg == "--latency" && i + 1 < argc) {
+      latency_seconds = std::stod(argv[++i]);
+    } else if (arg == "--memory-limit" && i + 1 < argc) {
+      // NAME=KB
+      std::string limit = argv[++i];
+      size_t eq = limit.find('=');
+      auto container = containerByName(limit.substr(0, eq));
+      if (eq == std::string::npos || !container) {
+        std::cerr << "Bad memory limit: " << limit << std::endl;
+        return 1;
+      }
+      memory_limits[*container] = std::stoul(limit.substr(eq + 1)) * 1024;
+    } else if (arg == "--soak" && i + 1 < argc) {
+      soak_hours = std::stod(argv[++i]);
+    } else if (arg == "--sample-ticks" && i + 1 < argc) {
+      sample_ticks = std::stoul(argv[++i]);
+    } else if (arg == "--batch" && i + 1 < argc) {
+      batch = std::stoul(argv[++i]);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = std::stoul(argv[++i]);
+    } else if (arg == "--policy" && i + 1 < argc) {
+      std::string name = argv[++i];
+      if (name == "idle") {
+        policy = Policy::IDLE;
+      } else if (name == "random") {
+        policy = Policy::RANDOM;
+      } else if (name == "script") {
+        policy = Policy::SCRIPT;
+      } else {
+        std::cerr << "Unknown policy: " << name << std::endl;
+        return 1;
+      }
+    } else if (arg == "--counters" && i + 1 < argc) {
+      counters_path = argv[++i];
+    } else if (arg == "--record" && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = std::stoi(argv[++i]);
+    } else if (arg == "--ticks" && i + 1 < argc) {
+      ticks = std::stoul(argv[++i]);
+    } else if (arg == "--start" && i + 1 < argc) {
+      startx = std::stod(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--replay FILE] [--seed N] [--ticks N] [--start X]\n"
+                   "       [--counters CSV] [--record FILE]\n"
+                   "       [--batch GAMES [--threads N]"
+                   " [--policy idle|random|script]]\n"
+                   "       [--soak HOURS [--sample-ticks N]"
+                   " [--memory-limit CONTAINER=KB]...]\n"
+                   "       [--alloc-check TICKS]"
+                   " [--perf BASELINE [--perf-update]"
+                   " [--perf-replay FILE]...]\n"
+                   "       [--latency SECONDS] [--run-ahead MAX_TICKS]"
+                   " [--pacing HZ]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  if (!perf_path.empty()) {
+    // compares against the baseline, or records into it with --perf-update;
+    // the simulation scenarios and then the replays
+    return runPerfGate(
+        perf_path, perf_update,
+        [&]() -> std::optional<std::vector<PerfResult>> {
+          std::vector<PerfResult> results = runSimulationPerf();
+          for (const auto& path : perf_replays) {
+            auto result = measureReplayPerf(path);
+            if (!result) {
+              std::cerr << "Could not play replay " << path << std::endl;
+              return std::nullopt;
+            }
+            results.push_back(*result);
+          }
+          return results;
+        });
+  }
+
+  if (alloc_check_ticks > 0) {
+    // --seed picks the cave and --start where to play it
+    return allocCheck(seed, startx, alloc_check_ticks);
+  }
+
+  if (pacing_hz > 0) {
+    // --seed picks the jitter
+    return pacingRun(seed, pacing_hz);
+  }
+
+  if (run_ahead_ticks > 0) {
+    // --seed picks the cave and --ticks the frames played per setting
+    return runAheadCost(seed, run_ahead_ticks, ticks);
+  }
+
+  if (latency_seconds > 0) {
+    // --seed picks the cave and the injected input
+    return latencyRun(seed, latency_seconds);
+  }
+
+  if (soak_hours > 0) {
+    // --seed picks the cave; the ship is invulnerable and game time is
+    // simulated flat out
+    SoakConfig config = {
+        .seed = seed,
+        .ticks = static_cast<uint64_t>(soak_hours * 3600 * 1000 /
+                                       default_tick_ms),
+        .sample_ticks = sample_ticks,
+        .limits = memory_limits,
+    };
+    SoakResult result = runSoak(config);
+    printf("%s", soakReport(result).c_str());
+    return result.failures.empty() ? 0 : 1;
+  }
+
+  if (batch > 0) {
+    // --seed is the first seed, --ticks caps every game and the replay, if
+    // any, is the script
+    std::optional<Replay> script;
+    if (policy == Policy::SCRIPT) {
+      script = Replay::load(replay_path);
+      if (!script) {
+        std::cerr << "The script policy needs a readable --replay"
+                  << std::endl;
+        return 1;
+      }
+    }
+    BatchConfig config = {
+        .games = batch,
+        .first_seed = seed,
+        .startx = startx,
+        .max_ticks = ticks,
+        .tick_ms = script ? script->tick_ms : default_tick_ms,
+        .policy = policy,
+        .script = script ? &*script : nullptr,
+    };
+    ThreadPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    auto results = runBatch(config, pool);
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+    printf("%s", batchReport(results, wall.count(), pool.size()).c_str());
+    return 0;
+  }
+
+  // without a replay the ship idles from the first tick
+  Replay replay;
+  if (!replay_path.empty()) {
+    auto loaded = Replay::load(replay_path);
+    if (!loaded) {
+      std::cerr << "Could not read replay " << replay_path << std::endl;
+      return 1;
+    }
+    replay = *loaded;
+  } else {
+    replay.seed = seed;
+    replay.startx = startx;
+    replay.start_tick = 0;
+    replay.commands.assign(ticks, 0);
+  }
+
+  Game game(replay.seed, replay.startx);
+  ReplayPlayer player(replay);
+  // the same commands, with the states this build reaches
+  Replay recording = replay;
+  recording.states.clear();
+
+  std::ofstream counters_csv;
+  if (!counters_path.empty()) {
+    counters_csv.open(counters_path);
+    counters_csv << "tick,tick_ns,collision_candidates,collision_hits,"
+                    "map_nodes_visited,boulders_generated,envelope_samples,"
+                    "spiders_generated,debris_spawned\n";
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto tick_start = start;
+  while (player.step(game)) {
+    if (!record_path.empty()) {
+      recording.recordState(game);
+    }
+    if (counters_csv.is_open()) {
+      std::chrono::duration<double, std::nano> cost =
+          std::chrono::steady_clock::now() - tick_start;
+      const TickCounters& c = game.cave.counters;
+      counters_csv << player.tick() << ',' << cost.count() << ','
+                   << c.collision_candidates << ',' << c.collision_hits << ','
+                   << c.map_nodes_visited << ',' << c.boulders_generated
+                   << ',' << c.envelope_samples << ',' << c.spiders_generated
+                   << ',' << c.debris_spawned << '\n';
+      tick_start = std::chrono::steady_clock::now();
+    }
+  }
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+  double game_time = player.tick() * replay.tick_ms / 1000.;
+  printf("seed: %d\n", replay.seed);
+  printf("ticks: %zu\n", player.tick());
+  printf("game time: %.2f s\n", game_time);
+  printf("wall time: %.3f s\n", wall.count());
+  printf("ticks/s: %.0f\n", player.tick() / wall.count());
+  printf("speed: %.1fx realtime\n", game_time / wall.count());
+  printf("distance: %.2f\n", game.distance());
+  printf("score: %" PRId64 "%s\n", game.score,
+         game.gameover ? " (game over)" : "");
+  printf("%s", memoryReport(game.cave.memoryUsage()).c_str());
+  if (!record_path.empty() && !recording.save(record_path)) {
+    std::cerr << "Could not write replay " << record_path << std::endl;
+    return 1;
+  }
+  if (!replay.states.empty()) {
+    printf("%s\n", player.divergence()
+                       ? divergenceReport(*player.divergence()).c_str()
+                       : "states match the replay");
+  }
+  if (allocationTrackingEnabled()) {
+    AllocationCounts counts[subsystem_count];
+    for (size_t i = 0; i < subsystem_count; ++i) {
+      counts[i] = allocationCounts(static_cast<Subsystem>(i));
+    }
+    printAllocations(counts);
+  }
+
+  return player.divergence() ? 1 : 0;
+}
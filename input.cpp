@@ -0,0 +1,24 @@
+#include "input.h"
+
+#include "latency.h"
+
+InputTimeline::InputTimeline(InputQueue& queue)
+    : queue_(queue) {}
+
+CommandMask InputTimeline::commandsUntil(uint64_t time_us) {
+  CommandMask pressed = 0;
+  for (const InputSample* sample = queue_.front();
+       sample && sample->time_us <= time_us; sample = queue_.front()) {
+    held_ = sample->held;
+    pressed |= sample->pressed;
+    if (tracker_) {
+      tracker_->consumed(sample->time_us);
+    }
+    queue_.pop();
+  }
+  return held_ | pressed;
+}
+
+CommandMask InputTimeline::held() const { return held_; }
+
+void InputTimeline::track(LatencyTracker* tracker) { tracker_ = tracker; }
@@ -0,0 +1,42 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <cstdint>
+
+#include "game.h"
+#include "spsc_queue.h"
+
+class LatencyTracker;
+
+// A key transition as seen by the event thread.
+struct InputSample {
+  uint64_t time_us;     // when the key event happened
+  CommandMask held;     // commands held from then on
+  CommandMask pressed;  // commands pressed by this transition
+};
+
+// Room for a burst of key events far larger than a frame ever sees.
+constexpr size_t input_queue_size = 256;
+using InputQueue = SpscQueue<InputSample, input_queue_size>;
+
+// The simulation's side of the input queue: folds the samples timestamped
+// up to a tick boundary into the commands of that tick. A command pressed
+// and released between two boundaries still lasts one tick.
+class InputTimeline
+{
+ public:
+  explicit InputTimeline(InputQueue& queue);
+
+  // Commands of the tick ending at time_us; consumes the samples up to it.
+  CommandMask commandsUntil(uint64_t time_us);
+  CommandMask held() const;
+  // Reports every sample consumed from now on to `tracker`, if any.
+  void track(LatencyTracker* tracker);
+
+ private:
+  InputQueue& queue_;
+  CommandMask held_ = 0;
+  LatencyTracker* tracker_ = nullptr;
+};
+
+#endif  // INPUT_H
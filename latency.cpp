@@ -0,0 +1,150 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+// what the injector holds: nothing, firing, moving or both
+constexpr CommandMask injected_commands[] = {
+    0,
+    commandBit(Command::FIRE),
+    commandBit(Command::THRUST_UP),
+    commandBit(Command::THRUST_DOWN),
+    commandBit(Command::FIRE) | commandBit(Command::THRUST_UP),
+    commandBit(Command::FIRE) | commandBit(Command::THRUST_DOWN),
+};
+
+}  // namespace
+
+const char* latencyStageName(LatencyStage stage) {
+  switch (stage) {
+    case LatencyStage::TICK:
+      return "tick";
+    case LatencyStage::DRAW:
+      return "draw";
+    case LatencyStage::PRESENT:
+      return "present";
+    case LatencyStage::COUNT:
+      break;
+  }
+  return "?";
+}
+
+void LatencyHistogram::add(uint64_t us) {
+  ++buckets[std::min<uint64_t>(us / bucket_us, buckets.size() - 1)];
+  ++count;
+  total_us += us;
+  max_us = std::max(max_us, us);
+}
+
+double LatencyHistogram::percentile(double p) const {
+  uint64_t rank = count * p;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen > rank) {
+      return (i + 1) * bucket_us / 1000.;
+    }
+  }
+  return 0;
+}
+
+void LatencyTracker::consumed(uint64_t input_us) {
+  if (consumed_.size() < max_pending) {
+    consumed_.push_back(input_us);
+  }
+}
+
+void LatencyTracker::ticked(uint64_t now_us) {
+  for (uint64_t input_us : consumed_) {
+    histograms_[static_cast<size_t>(LatencyStage::TICK)].add(now_us -
+                                                             input_us);
+    if (pending_.size() < max_pending) {
+      pending_.push_back(input_us);
+    }
+  }
+  consumed_.clear();
+}
+
+void LatencyTracker::drawn(uint64_t now_us) {
+  for (uint64_t input_us : pending_) {
+    histograms_[static_cast<size_t>(LatencyStage::DRAW)].add(now_us -
+                                                             input_us);
+  }
+}
+
+void LatencyTracker::presented(uint64_t now_us) {
+  for (uint64_t input_us : pending_) {
+    histograms_[static_cast<size_t>(LatencyStage::PRESENT)].add(now_us -
+                                                                input_us);
+  }
+  pending_.clear();
+}
+
+const LatencyHistogram& LatencyTracker::histogram(LatencyStage stage) const {
+  return histograms_[static_cast<size_t>(stage)];
+}
+
+std::string LatencyTracker::report() const {
+  std::string report;
+  char line[256];
+  for (size_t i = 0; i < latency_stage_count; ++i) {
+    const LatencyHistogram& h = histograms_[i];
+    snprintf(line, sizeof(line),
+             "%-8s %6" PRIu64 " inputs, p50 %5.1f ms, p90 %5.1f ms, "
+             "p99 %5.1f ms, max %5.1f ms\n",
+             latencyStageName(static_cast<LatencyStage>(i)), h.count,
+             h.percentile(0.5), h.percentile(0.9), h.percentile(0.99),
+             h.max_us / 1000.);
+    report += line;
+  }
+  report += "stage,bucket_ms,inputs\n";
+  for (size_t i = 0; i < latency_stage_count; ++i) {
+    const LatencyHistogram& h = histograms_[i];
+    for (size_t b = 0; b < h.buckets.size(); ++b) {
+      if (h.buckets[b]) {
+        snprintf(line, sizeof(line), "%s,%.1f,%" PRIu64 "\n",
+                 latencyStageName(static_cast<LatencyStage>(i)),
+                 b * LatencyHistogram::bucket_us / 1000., h.buckets[b]);
+        report += line;
+      }
+    }
+  }
+  return report;
+}
+
+InputInjector::InputInjector(InputQueue& queue, Clock clock, int seed)
+    : queue_(queue)
+    , clock_(std::move(clock))
+    , thread_(&InputInjector::run, this, seed) {}
+
+InputInjector::~InputInjector() {
+  stop_ = true;
+  thread_.join();
+}
+
+uint64_t InputInjector::dropped() const { return dropped_; }
+
+void InputInjector::run(int seed) {
+  std::default_random_engine generator(seed);
+  std::uniform_int_distribution<int> d_wait_ms{30, 250};
+  std::uniform_int_distribution<size_t> d_commands{
+      0, std::size(injected_commands) - 1};
+  CommandMask held = 0;
+  while (!stop_) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(d_wait_ms(generator)));
+    CommandMask next = injected_commands[d_commands(generator)];
+    if (next == held) {
+      continue;
+    }
+    if (!queue_.push({clock_(), next, static_cast<CommandMask>(next & ~held)})) {
+      ++dropped_;
+    }
+    held = next;
+  }
+}
@@ -0,0 +1,89 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "fixed_vector.h"
+#include "input.h"
+
+// Where an input is on its way to the screen: simulated by a tick, drawn,
+// then presented by the flip.
+enum class LatencyStage {
+  TICK,
+  DRAW,
+  PRESENT,
+  COUNT,
+};
+
+constexpr size_t latency_stage_count = static_cast<size_t>(LatencyStage::COUNT);
+
+const char* latencyStageName(LatencyStage stage);
+
+// Latencies in half millisecond buckets, the last one open ended.
+struct LatencyHistogram {
+  static constexpr uint64_t bucket_us = 500;
+  std::array<uint64_t, 128> buckets = {};
+  uint64_t count = 0;
+  uint64_t total_us = 0;
+  uint64_t max_us = 0;
+
+  void add(uint64_t us);
+  // Upper edge of the bucket holding the pth latency, in milliseconds.
+  double percentile(double p) const;
+};
+
+// Follows every input sample from its key event to the flip that first
+// shows its effect.
+class LatencyTracker
+{
+ public:
+  // The tick being simulated consumed a sample stamped input_us.
+  void consumed(uint64_t input_us);
+  // Calls after the tick, after drawing and after the flip.
+  void ticked(uint64_t now_us);
+  void drawn(uint64_t now_us);
+  void presented(uint64_t now_us);
+
+  const LatencyHistogram& histogram(LatencyStage stage) const;
+  // p50, p90, p99 and max per stage, then the non empty buckets as CSV.
+  std::string report() const;
+
+ private:
+  // more than a frame ever sees; inputs beyond are not followed
+  static constexpr size_t max_pending = 64;
+
+  std::array<LatencyHistogram, latency_stage_count> histograms_;
+  FixedVector<uint64_t, max_pending> consumed_;  // by the tick being run
+  FixedVector<uint64_t, max_pending> pending_;   // simulated, not presented
+};
+
+// Feeds an InputQueue from a thread of its own with random presses and
+// releases a few times a second, so that latency can be measured
+// unattended. It must be the queue's only producer.
+class InputInjector
+{
+ public:
+  using Clock = std::function<uint64_t()>;  // microseconds
+
+  InputInjector(InputQueue& queue, Clock clock, int seed = 0);
+  ~InputInjector();
+
+  uint64_t dropped() const;
+
+ private:
+  void run(int seed);
+
+ private:
+  InputQueue& queue_;
+  Clock clock_;
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> dropped_{0};
+  std::thread thread_;
+};
+
+#endif  // LATENCY_H
@@ -4,46 +4,389 @@
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_ttf.h>
 
+#include <algorithm>
+#include <array>
+#include <fstream>
 #include <iostream>
 #include <memory>
-#include <unordered_set>
+#include <optional>
+#include <string>
 
+#include "alloc_tracker.h"
+#include "clock.h"
 #include "game.h"
+#include "input.h"
+#include "latency.h"
+#include "perf.h"
 #include "renderer.h"
+#include "replay.h"
+#include "runahead.h"
 
 constexpr int WINDOW_WIDTH = 1280;
 constexpr int WINDOW_HEIGHT = 720;
+// longest stretch of time simulated at once, e.g. after the window was dragged
+constexpr uint32_t max_lag_ms = 250;
+// wall time spent simulating per frame in fast forward
+constexpr Nanos fast_forward_slice = std::chrono::milliseconds(10);
+
+// Allegro's seconds, e.g. of al_get_time() and event timestamps.
+Nanos fromSeconds(double seconds) {
+  return std::chrono::duration_cast<Nanos>(
+      std::chrono::duration<double>(seconds));
+}
+
+// exit code of checks that cannot run here, e.g. without a display; CTest
+// counts it as skipped
+constexpr int skip_exit_code = 77;
+
+// frame rate when the display doesn't report its refresh rate
+constexpr int default_refresh_rate = 60;
+
+// Seconds per frame, one frame per display refresh.
+double frameInterval(ALLEGRO_DISPLAY* display) {
+  int refresh_rate = al_get_display_refresh_rate(display);
+  return 1.0 / (refresh_rate > 0 ? refresh_rate : default_refresh_rate);
+}
+
+// Commands of the keys held; opposite directions cancel out.
+CommandMask heldCommands(const std::array<bool, ALLEGRO_KEY_MAX>& held) {
+  CommandMask mask = 0;
+  if (held[ALLEGRO_KEY_UP] ^ held[ALLEGRO_KEY_DOWN] ^ held[ALLEGRO_KEY_W] ^
+      held[ALLEGRO_KEY_S]) {
+    mask |= commandBit(held[ALLEGRO_KEY_UP] || held[ALLEGRO_KEY_W]
+                           ? Command::THRUST_UP
+                           : Command::THRUST_DOWN);
+  }
+  if (held[ALLEGRO_KEY_RIGHT] ^ held[ALLEGRO_KEY_LEFT] ^ held[ALLEGRO_KEY_A] ^
+      held[ALLEGRO_KEY_D]) {
+    mask |= commandBit(held[ALLEGRO_KEY_RIGHT] || held[ALLEGRO_KEY_D]
+                           ? Command::THRUST_FORWARD
+                           : Command::THRUST_BACKWARD);
+  }
+  if (held[ALLEGRO_KEY_SPACE]) {
+    mask |= commandBit(Command::FIRE);
+  }
+  return mask;
+}
+
+// Times ticking and drawing a fixed seed into an offscreen bitmap, the CPU
+// side of a frame, against the baseline.
+int runDrawPerf(const std::string& path, bool update) {
+  ALLEGRO_BITMAP* target = al_create_bitmap(WINDOW_WIDTH, WINDOW_HEIGHT);
+  al_set_target_bitmap(target);
+  Renderer renderer(WINDOW_WIDTH, WINDOW_HEIGHT);
+  int result = runPerfGate(
+      path, update, [&]() -> std::optional<std::vector<PerfResult>> {
+        // ticks firing in bursts, each drawn
+        return std::vector<PerfResult>{
+            measurePerf("frame", 300, 3000, 5, [&]() -> PerfStep {
+              auto game = std::make_shared<Game>(1);
+              game->started = true;
+              game->invulnerable = true;
+              auto frame = std::make_shared<uint64_t>(0);
+              return [game, frame, &renderer]() {
+                CommandMask commands = ++*frame % 40 < 20
+                                           ? commandBit(Command::FIRE)
+                                           : CommandMask(0);
+                game->step(commands, default_tick_ms);
+                al_clear_to_color(al_map_rgb(0, 0, 0));
+                renderer.draw(*game);
+              };
+            }),
+        };
+      });
+  al_destroy_bitmap(target);
+  return result;
+}
+
+// Ticks and draws a fixed seed into an offscreen bitmap, firing in bursts,
+// and fails if any frame past the first half still touches the heap.
+int allocCheckFrames(uint64_t frames) {
+  if (!allocationTrackingEnabled()) {
+    std::cerr << "--alloc-check needs a build with HSS_TRACK_ALLOCATIONS"
+              << std::endl;
+    return 1;
+  }
+  ALLEGRO_BITMAP* target = al_create_bitmap(WINDOW_WIDTH, WINDOW_HEIGHT);
+  al_set_target_bitmap(target);
+  Renderer renderer(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Game game(1);
+  game.started = true;
+  game.invulnerable = true;
+
+  AllocationCounts before[subsystem_count];
+  uint64_t warmup = frames / 2;
+  for (uint64_t frame = 1; frame <= frames; ++frame) {
+    if (frame == warmup + 1) {
+      for (size_t i = 0; i < subsystem_count; ++i) {
+        before[i] = allocationCounts(static_cast<Subsystem>(i));
+      }
+    }
+    CommandMask commands =
+        frame % 40 < 20 ? commandBit(Command::FIRE) : CommandMask(0);
+    game.step(commands, default_tick_ms);
+    al_clear_to_color(al_map_rgb(0, 0, 0));
+    renderer.draw(game);
+  }
+
+  uint64_t allocations = 0;
+  for (size_t i = 0; i < subsystem_count; ++i) {
+    AllocationCounts after =
+        allocationCounts(static_cast<Subsystem>(i)) - before[i];
+    printf("%s: %" PRIu64 " allocations, %" PRIu64 " frees, %" PRIu64
+           " bytes\n",
+           subsystemName(static_cast<Subsystem>(i)), after.allocations,
+           after.frees, after.bytes);
+    allocations += after.allocations;
+  }
+  al_destroy_bitmap(target);
+  printf("steady state: frames %" PRIu64 " to %" PRIu64 "\n%s\n", warmup + 1,
+         frames, allocations ? "FAIL" : "PASS");
+  return allocations ? 1 : 0;
+}
 
 int real_main(int argc, char** argv) {
+  size_t debris_budget = default_debris_budget;
+  OverflowPolicy debris_policy = OverflowPolicy::DROP_OLDEST;
+  std::string record_path;
+  std::string replay_path;
+  std::string counters_path;
+  std::string perf_path;
+  bool perf_update = false;
+  bool fast_forward = false;
+  MemoryLimits memory_limits;
+  double memory_log_interval = 0;
+  double inject_seconds = 0;
+  uint64_t alloc_check_frames = 0;
+  int run_ahead_ticks = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--fast-forward") {
+      fast_forward = true;
+    } else if (arg == "--run-ahead" && i + 1 < argc) {
+      run_ahead_ticks = std::stoi(argv[++i]);
+    } else if (arg == "--alloc-check" && i + 1 < argc) {
+      alloc_check_frames = std::stoull(argv[++i]);
+    } else if (arg == "--inject" && i + 1 < argc) {
+      inject_seconds = std::stod(argv[++i]);
+    } else if (arg == "--perf" && i + 1 < argc) {
+      perf_path = argv[++i];
+    } else if (arg == "--perf-update") {
+      perf_update = true;
+    } else if (arg == "--memory-limit" && i + 1 < argc) {
+      // NAME=KB
+      std::string limit = argv[++i];
+      size_t eq = limit.find('=');
+      auto container = containerByName(limit.substr(0, eq));
+      if (eq == std::string::npos || !container) {
+        std::cerr << "Bad memory limit: " << limit << std::endl;
+        return 1;
+      }
+      memory_limits[*container] = std::stoul(limit.substr(eq + 1)) * 1024;
+    } else if (arg == "--memory-log" && i + 1 < argc) {
+      memory_log_interval = std::stod(argv[++i]);
+    } else if (arg == "--counters" && i + 1 < argc) {
+      counters_path = argv[++i];
+    } else if (arg == "--record" && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else if (arg == "--debris-budget" && i + 1 < argc) {
+      debris_budget = std::stoul(argv[++i]);
+      if (debris_budget == 0 || debris_budget > max_debris_budget) {
+        std::cerr << "Debris budget must be 1 to " << max_debris_budget
+                  << std::endl;
+        return 1;
+      }
+    } else if (arg == "--debris-policy" && i + 1 < argc) {
+      std::string policy = argv[++i];
+      if (policy == "drop") {
+        debris_policy = OverflowPolicy::DROP_OLDEST;
+      } else if (policy == "merge") {
+        debris_policy = OverflowPolicy::MERGE;
+      } else if (policy == "shorten") {
+        debris_policy = OverflowPolicy::SHORTEN_LIFETIME;
+      } else {
+        std::cerr << "Unknown debris policy: " << policy << std::endl;
+        return 1;
+      }
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--fast-forward] [--record FILE] [--replay FILE]"
+                   " [--debris-budget N]"
+                   " [--debris-policy drop|merge|shorten]\n"
+                   "       [--memory-limit CONTAINER=KB]..."
+                   " [--memory-log SECONDS] [--counters CSV]\n"
+                   "       [--perf BASELINE [--perf-update]]"
+                   " [--alloc-check FRAMES]\n"
+                   "       [--inject SECONDS] [--run-ahead TICKS]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  Replay recording;
+  std::optional<Replay> replay;
+  if (!replay_path.empty()) {
+    replay = Replay::load(replay_path);
+    if (!replay) {
+      std::cerr << "Could not read replay " << replay_path << std::endl;
+      return 1;
+    }
+  }
+
   al_init();
   al_install_keyboard();
+  // before any drawing, including the offscreen checks below
+  al_init_primitives_addon();
 
-  ALLEGRO_TIMER* timer = al_create_timer(1.0 / 60.0);
   ALLEGRO_EVENT_QUEUE* queue = al_create_event_queue();
 
   al_set_new_display_flags(ALLEGRO_RESIZABLE);
+  // flips wait for the vertical blank where the driver lets them
+  al_set_new_display_option(ALLEGRO_VSYNC, 1, ALLEGRO_SUGGEST);
   ALLEGRO_DISPLAY* display = al_create_display(WINDOW_WIDTH, WINDOW_HEIGHT);
+  if (!display) {
+    std::cerr << "Could not create a display" << std::endl;
+    al_destroy_event_queue(queue);
+    bool check = !perf_path.empty() || alloc_check_frames;
+    return check ? skip_exit_code : 1;
+  }
+
+  if (alloc_check_frames || !perf_path.empty()) {
+    int result = alloc_check_frames
+                     ? allocCheckFrames(alloc_check_frames)
+                     : runDrawPerf(perf_path, perf_update);
+    al_destroy_display(display);
+    al_destroy_event_queue(queue);
+    return result;
+  }
+
+  ALLEGRO_TIMER* timer = al_create_timer(frameInterval(display));
 
   al_register_event_source(queue, al_get_keyboard_event_source());
   al_register_event_source(queue, al_get_display_event_source(display));
 
   al_register_event_source(queue, al_get_timer_event_source(timer));
 
-  al_init_primitives_addon();
   al_init_ttf_addon();
 
   ALLEGRO_FONT* font = al_load_ttf_font("IBMPlexMono-Medium.ttf", 18, 0);
   ALLEGRO_FONT* big_font = al_load_ttf_font("IBMPlexMono-Medium.ttf", 30, 0);
 
-  Game game;
+  Game game(replay ? replay->seed : recording.seed,
+            replay ? replay->startx : recording.startx);
+  game.cave.debris.configure(debris_budget, debris_policy);
+  game.memory_limits = memory_limits;
   Renderer renderer(WINDOW_WIDTH, WINDOW_HEIGHT);
 
-  uint32_t last_ticks = al_get_time() * 1000;
-  std::unordered_set<Command> commands;
+  std::optional<ReplayPlayer> player;
+  if (replay) {
+    player.emplace(*replay);
+  }
+  const uint32_t tick_ms = replay ? replay->tick_ms : recording.tick_ms;
+
+  // time for ticks, frames and input; events are stamped by Allegro on a
+  // clock of its own, which is moved onto this one
+  Clock clock;
+  const Nanos allegro_origin = clock.now() - fromSeconds(al_get_time());
+  auto eventMicros = [&](const ALLEGRO_EVENT& event) {
+    return toMicros(allegro_origin + fromSeconds(event.any.timestamp));
+  };
+  // time the simulation has caught up to, on a tick boundary
+  Nanos simulated = clock.now();
+  const Nanos tick_length = std::chrono::milliseconds(tick_ms);
+  const Nanos max_lag = std::chrono::milliseconds(max_lag_ms);
+  // frames show evenly spaced times, though they are measured with jitter
+  FramePacer pacer(fromSeconds(frameInterval(display)), max_lag);
+  // from the last tick to the time the frame shows
+  Nanos lead{0};
+  // key transitions go from event handling to the ticks through the queue,
+  // timestamped, so the simulation could run on a thread of its own
+  std::array<bool, ALLEGRO_KEY_MAX> held = {};
+  InputQueue input_queue;
+  InputTimeline input(input_queue);
+  uint64_t input_dropped = 0;
+  // from key event to tick, drawing and flip, for every input
+  LatencyTracker latency;
+  input.track(&latency);
+  // with --inject, random input replaces the keyboard for a while and the
+  // latencies are printed at the end
+  std::optional<InputInjector> injector;
+  Nanos inject_until{0};
+  if (inject_seconds > 0 && !player) {
+    injector.emplace(input_queue, [&clock] { return clock.micros(); });
+    inject_until = clock.now() + fromSeconds(inject_seconds);
+    game.started = true;
+  }
+
+  // frames blend the camera and ship from where they were before the last
+  // tick towards where it left them, by how far past that tick the frame
+  // shows; with --run-ahead a copy of the game a few ticks ahead is drawn
+  // instead
+  TickBlend before_tick = TickBlend::at(game);
+  std::optional<RunAhead> run_ahead;
+  if (run_ahead_ticks > 0) {
+    run_ahead.emplace(run_ahead_ticks);
+  }
+
+  // simulated versus wall time, refreshed twice a second
+  double speed = 1;
+  double speed_since = al_get_time();
+  uint64_t speed_ticks = 0;
+
+  double memory_logged = al_get_time();
+
+  // work done for the frame being simulated and for the last one drawn
+  TickCounters frame_counters;
+  TickCounters drawn_counters;
+  uint32_t frame_ticks = 0;
+  uint32_t drawn_ticks = 0;
+  // heap allocations per subsystem since the previous frame was drawn
+  AllocationCounts allocations_seen[subsystem_count];
+  AllocationCounts drawn_allocations[subsystem_count];
+  Nanos last_draw = clock.now();
+  // measured and shown frame intervals, refreshed with the speed
+  FrameStats measured_frames;
+  FrameStats shown_frames;
+  std::ofstream counters_csv;
+  if (!counters_path.empty()) {
+    counters_csv.open(counters_path);
+    counters_csv << "frame,frame_ms,ticks,collision_candidates,"
+                    "collision_hits,map_nodes_visited,boulders_generated,"
+                    "envelope_samples,spiders_generated,debris_spawned,"
+                    "primitive_calls,triangles,shown_ms\n";
+  }
+
+  bool divergence_reported = false;
+  // one tick ending at `boundary`
+  auto tick = [&](Nanos boundary) {
+    before_tick = TickBlend::at(game);
+    CommandMask mask = input.commandsUntil(toMicros(boundary));
+    if (player) {
+      player->step(game);
+      if (player->divergence() && !divergence_reported) {
+        std::cerr << "Replay " << divergenceReport(*player->divergence())
+                  << std::endl;
+        divergence_reported = true;
+      }
+    } else {
+      if (!record_path.empty()) {
+        recording.record(game, mask);
+      }
+      game.step(mask, tick_ms);
+      if (!record_path.empty()) {
+        recording.recordState(game);
+      }
+    }
+    latency.ticked(clock.micros());
+    ++speed_ticks;
+    frame_counters += game.cave.counters;
+    ++frame_ticks;
+  };
 
   ALLEGRO_COLOR text_color = al_map_rgb(0, 255, 0);
   ALLEGRO_EVENT event;
-  ALLEGRO_KEYBOARD_STATE ks;
 
   char strbuff[200];
   bool redraw = true;
@@ -53,64 +396,130 @@ int real_main(int argc, char** argv) {
 
   bool done = false;
   while (!done) {
+    // Sleep until something arrives, then drain the queue: events only
+    // update state, and a frame, simulated up to now and presented once, is
+    // due only on a timer tick however many events came with it.
     al_wait_for_event(queue, &event);
-
-    if (event.type == ALLEGRO_EVENT_DISPLAY_RESIZE) {
-      int width = al_get_display_width(display);
-      int height = width * 720. / 1280.;
-      al_resize_display(display, width, height);
-      al_acknowledge_resize(display);
-      renderer.reset(width, height);
-    } else if (event.type == ALLEGRO_EVENT_TIMER) {
-      redraw = true;
-    } else if (event.type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
-      done = true;
-    } else if (event.type == ALLEGRO_EVENT_KEY_DOWN) {
-      if (event.keyboard.keycode == ALLEGRO_KEY_ESCAPE) {
-        game.ship.health = 0;
+    do {
+      if (event.type == ALLEGRO_EVENT_DISPLAY_RESIZE) {
+        int width = al_get_display_width(display);
+        int height = width * 720. / 1280.;
+        al_resize_display(display, width, height);
+        al_acknowledge_resize(display);
+        renderer.reset(width, height);
+        // it may have moved to a display with another refresh rate
+        al_set_timer_speed(timer, frameInterval(display));
+        pacer.setRefresh(fromSeconds(frameInterval(display)));
+      } else if (event.type == ALLEGRO_EVENT_TIMER) {
+        redraw = true;
+      } else if (event.type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
+        done = true;
+      } else if (event.type == ALLEGRO_EVENT_KEY_DOWN) {
+        held[event.keyboard.keycode] = true;
+        CommandMask mask = heldCommands(held);
+        CommandMask pressed =
+            event.keyboard.keycode == ALLEGRO_KEY_ESCAPE
+                ? mask | commandBit(Command::GIVE_UP)
+                : mask;
+        if (!injector && !input_queue.push(
+                             {eventMicros(event), mask, pressed})) {
+          ++input_dropped;
+        }
+        if (event.keyboard.keycode == ALLEGRO_KEY_F1) {
+          game.debug = !game.debug;
+        }
+        if (event.keyboard.keycode == ALLEGRO_KEY_F2) {
+          fast_forward = !fast_forward;
+        }
+        if (!player && !game.started &&
+            event.keyboard.keycode == ALLEGRO_KEY_SPACE) {
+          game.started = true;
+        }
+      } else if (event.type == ALLEGRO_EVENT_KEY_UP) {
+        held[event.keyboard.keycode] = false;
+        if (!injector &&
+            !input_queue.push(
+                {eventMicros(event), heldCommands(held), 0})) {
+          ++input_dropped;
+        }
       }
-      if (event.keyboard.keycode == ALLEGRO_KEY_F1) {
-        game.debug = !game.debug;
+    } while (al_get_next_event(queue, &event));
+
+    if (redraw && fast_forward) {
+      // simulate flat out for a slice of the frame
+      Nanos until = clock.now() + fast_forward_slice;
+      simulated = clock.now();
+      do {
+        for (int i = 0; i < 16; ++i) {
+          tick(simulated);
+        }
+      } while (clock.now() < until);
+      lead = Nanos(0);
+    } else if (redraw) {
+      Nanos now = pacer.frame(clock.now());
+      // time beyond max_lag is dropped rather than caught up on
+      if (now - simulated > max_lag) {
+        simulated = now - max_lag;
       }
-      if (!game.started && event.keyboard.keycode == ALLEGRO_KEY_SPACE) {
-        game.started = true;
+      while (now - simulated >= tick_length) {
+        simulated += tick_length;
+        tick(simulated);
       }
+      lead = std::max(now - simulated, Nanos(0));
     }
 
-    al_get_keyboard_state(&ks);
-
-    commands.clear();
-
-    if (al_key_down(&ks, ALLEGRO_KEY_UP) ^ al_key_down(&ks, ALLEGRO_KEY_DOWN) ^
-        al_key_down(&ks, ALLEGRO_KEY_W) ^ al_key_down(&ks, ALLEGRO_KEY_S)) {
-      commands.insert(al_key_down(&ks, ALLEGRO_KEY_UP) ||
-                              al_key_down(&ks, ALLEGRO_KEY_W)
-                          ? Command::THRUST_UP
-                          : Command::THRUST_DOWN);
-    }
-    if (al_key_down(&ks, ALLEGRO_KEY_RIGHT) ^
-        al_key_down(&ks, ALLEGRO_KEY_LEFT) ^ al_key_down(&ks, ALLEGRO_KEY_A) ^
-        al_key_down(&ks, ALLEGRO_KEY_D)) {
-      commands.insert(al_key_down(&ks, ALLEGRO_KEY_RIGHT) ||
-                              al_key_down(&ks, ALLEGRO_KEY_D)
-                          ? Command::THRUST_FORWARD
-                          : Command::THRUST_BACKWARD);
-    }
-    if (al_key_down(&ks, ALLEGRO_KEY_SPACE)) {
-      commands.insert({Command::FIRE});
+    double now = al_get_time();
+    if (now - speed_since >= 0.5) {
+      speed = speed_ticks * tick_ms / 1000. / (now - speed_since);
+      speed_since = now;
+      speed_ticks = 0;
+      measured_frames = pacer.measured();
+      shown_frames = pacer.shown();
+      pacer.resetStats();
     }
-    if (!game.gameover) {
-      game.commands(commands);
+    if (memory_log_interval > 0 && now - memory_logged >= memory_log_interval) {
+      std::clog << "memory at " << static_cast<int>(now) << " s\n"
+                << memoryReport(game.cave.memoryUsage()) << std::flush;
+      memory_logged = now;
     }
 
-    uint32_t ticks = al_get_time() * 1000;
-    uint32_t dt = ticks - last_ticks;
-    game.update(dt);
-    last_ticks = ticks;
-
-    if (redraw && al_is_event_queue_empty(queue)) {
+    if (redraw) {
       al_clear_to_color(al_map_rgb(0, 0, 0));
-      renderer.draw(game);
+      // replays and fast forward have no input to predict
+      if (run_ahead && !player && !fast_forward) {
+        renderer.draw(run_ahead->predict(game, input.held(), tick_ms));
+      } else if (!fast_forward) {
+        before_tick.alpha =
+            std::min(static_cast<float>(lead.count()) / tick_length.count(),
+                     1.f);
+        renderer.draw(game, before_tick);
+      } else {
+        renderer.draw(game);
+      }
+      latency.drawn(clock.micros());
+
+      Nanos now = clock.now();
+      drawn_counters = frame_counters;
+      drawn_ticks = frame_ticks;
+      for (size_t i = 0; i < subsystem_count; ++i) {
+        AllocationCounts seen = allocationCounts(static_cast<Subsystem>(i));
+        drawn_allocations[i] = seen - allocations_seen[i];
+        allocations_seen[i] = seen;
+      }
+      if (counters_csv.is_open()) {
+        const TickCounters& c = drawn_counters;
+        const DrawCounters& d = renderer.counters();
+        counters_csv << frame << ',' << (now - last_draw).count() / 1e6 << ','
+                     << drawn_ticks << ',' << c.collision_candidates << ','
+                     << c.collision_hits << ',' << c.map_nodes_visited << ','
+                     << c.boulders_generated << ',' << c.envelope_samples
+                     << ',' << c.spiders_generated << ',' << c.debris_spawned
+                     << ',' << d.primitive_calls << ',' << d.triangles << ','
+                     << pacer.dt().count() / 1e6 << '\n';
+      }
+      last_draw = now;
+      frame_counters = {};
+      frame_ticks = 0;
       if (!game.started) {
         int line = 0;
         al_draw_text(big_font, text_color, 400, 150 + ++line * 30, 0,
@@ -136,9 +545,17 @@ int real_main(int argc, char** argv) {
         al_draw_text(big_font, text_color, 550, 310, 0, strbuff);
       }
 
+      if (fast_forward) {
+        snprintf(strbuff, sizeof(strbuff), "Fast forward %.1fx", speed);
+        al_draw_text(font, text_color, al_get_display_width(display) - 250, 18,
+                     0, strbuff);
+      }
+
       if (game.debug) {
         const int fontsize = 18;
         int stri = 0;
+        snprintf(strbuff, sizeof(strbuff), "Speed: %.2fx realtime", speed);
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
         snprintf(strbuff, sizeof(strbuff), "Score: %" PRId64, game.score);
         al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
         // snprintf(strbuff, sizeof(strbuff), "FPS: %.1f", 1000.f / dt);
@@ -148,11 +565,15 @@ int real_main(int argc, char** argv) {
                  game.ship.multiplier);
         al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
 
+        CommandMask held_mask = input.held();
+        auto down = [held_mask](Command command) {
+          return (held_mask & commandBit(command)) != 0;
+        };
         std::string commands_str = "";
-        commands_str += commands.count(Command::THRUST_BACKWARD) ? "<" : " ";
-        commands_str += commands.count(Command::THRUST_UP) ? "^" : " ";
-        commands_str += commands.count(Command::THRUST_DOWN) ? "v" : " ";
-        commands_str += commands.count(Command::THRUST_FORWARD) ? ">" : " ";
+        commands_str += down(Command::THRUST_BACKWARD) ? "<" : " ";
+        commands_str += down(Command::THRUST_UP) ? "^" : " ";
+        commands_str += down(Command::THRUST_DOWN) ? "v" : " ";
+        commands_str += down(Command::THRUST_FORWARD) ? ">" : " ";
         snprintf(strbuff, sizeof(strbuff), "Commands: %s",
                  commands_str.c_str());
         al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
@@ -169,8 +590,9 @@ int real_main(int argc, char** argv) {
         snprintf(strbuff, sizeof(strbuff), "Spits: %zu",
                  game.cave.spits.size());
         al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
-        snprintf(strbuff, sizeof(strbuff), "Debris: %zu",
-                 game.cave.debris.size());
+        snprintf(strbuff, sizeof(strbuff), "Debris: %zu/%zu (peak %zu)",
+                 game.cave.debris.size(), game.cave.debris.capacity(),
+                 game.cave.debris.highWater());
         al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
         snprintf(strbuff, sizeof(strbuff), "Floor spiders: %zu",
                  game.cave.floor_spiders.size());
@@ -182,14 +604,105 @@ int real_main(int argc, char** argv) {
         snprintf(strbuff, sizeof(strbuff), "Collisions: %zu",
                  game.collisions.size());
         al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+        snprintf(strbuff, sizeof(strbuff), "Input events dropped: %" PRIu64,
+                 input_dropped);
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+
+        const TickCounters& c = drawn_counters;
+        snprintf(strbuff, sizeof(strbuff), "Ticks: %u", drawn_ticks);
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+        snprintf(strbuff, sizeof(strbuff),
+                 "Collision tests: %u (%u hits, %u nodes)",
+                 c.collision_candidates, c.collision_hits,
+                 c.map_nodes_visited);
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+        snprintf(strbuff, sizeof(strbuff),
+                 "Generated: %u boulders, %u samples, %u spiders",
+                 c.boulders_generated, c.envelope_samples,
+                 c.spiders_generated);
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+        snprintf(strbuff, sizeof(strbuff), "Debris spawned: %u",
+                 c.debris_spawned);
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+        snprintf(strbuff, sizeof(strbuff), "Draw: %u calls, %u triangles",
+                 renderer.counters().primitive_calls,
+                 renderer.counters().triangles);
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+
+        if (allocationTrackingEnabled()) {
+          std::string line = "Allocations:";
+          for (size_t i = 0; i < subsystem_count; ++i) {
+            snprintf(strbuff, sizeof(strbuff), " %s %" PRIu64,
+                     subsystemName(static_cast<Subsystem>(i)),
+                     drawn_allocations[i].allocations);
+            line += strbuff;
+          }
+          al_draw_text(font, text_color, 20, ++stri * fontsize, 0,
+                       line.c_str());
+        }
+
+        for (size_t i = 0; i < latency_stage_count; ++i) {
+          auto stage = static_cast<LatencyStage>(i);
+          const LatencyHistogram& h = latency.histogram(stage);
+          snprintf(strbuff, sizeof(strbuff),
+                   "Latency to %-7s p50 %4.1f p99 %4.1f max %4.1f ms (%" PRIu64
+                   ")",
+                   latencyStageName(stage), h.percentile(0.5),
+                   h.percentile(0.99), h.max_us / 1000., h.count);
+          al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+        }
+
+        snprintf(strbuff, sizeof(strbuff),
+                 "Frames: %.2f ms, jitter %.2f ms measured, %.2f ms shown",
+                 measured_frames.mean(), measured_frames.jitter(),
+                 shown_frames.jitter());
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+        if (run_ahead) {
+          const RunAheadCost& cost = run_ahead->cost();
+          snprintf(strbuff, sizeof(strbuff),
+                   "Ahead %d ticks: %.1f us per frame (copy %.1f us)",
+                   run_ahead->ticks(), cost.frameUs(),
+                   cost.frames ? cost.copy_ns / cost.frames / 1000 : 0.);
+        } else {
+          snprintf(strbuff, sizeof(strbuff), "Blended %.1f ms past the tick",
+                   lead.count() / 1e6);
+        }
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+
+        MemoryUsage memory = game.cave.memoryUsage();
+        snprintf(strbuff, sizeof(strbuff), "Memory: %zu KB",
+                 memory.allocatedBytes() / 1024);
+        al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+        for (size_t i = 0; i < container_count; ++i) {
+          const ContainerUsage& usage = memory.containers[i];
+          snprintf(strbuff, sizeof(strbuff), "  %-10s %6zu %6zu KB%s",
+                   containerName(static_cast<Container>(i)), usage.count,
+                   usage.allocated_bytes / 1024,
+                   usage.evicted ? " (capped)" : "");
+          al_draw_text(font, text_color, 20, ++stri * fontsize, 0, strbuff);
+        }
       }
 
       al_flip_display();
+      // under vsync the flip returns once the frame is on its way to the
+      // screen, the closest to photons the program sees
+      latency.presented(clock.micros());
 
       redraw = false;
+      ++frame;
     }
+    if (injector && clock.now() >= inject_until) {
+      done = true;
+    }
+  }
+
+  if (injector) {
+    printf("%s", latency.report().c_str());
+    printf("injected inputs dropped: %" PRIu64 "\n", injector->dropped());
+  }
 
-    ++frame;
+  if (!record_path.empty() && !recording.save(record_path)) {
+    std::cerr << "Could not write replay " << record_path << std::endl;
   }
 
   al_destroy_font(font);
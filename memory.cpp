@@ -0,0 +1,60 @@
+#include "memory.h"
+
+#include <cstdio>
+
+const char* containerName(Container container) {
+  switch (container) {
+    case Container::BOULDERS:
+      return "boulders";
+    case Container::ENVELOPE:
+      return "envelope";
+    case Container::BACKGROUND:
+      return "background";
+    case Container::SPIDERS:
+      return "spiders";
+    case Container::BULLETS:
+      return "bullets";
+    case Container::SPITS:
+      return "spits";
+    case Container::DEBRIS:
+      return "debris";
+    case Container::COUNT:
+      break;
+  }
+  return "?";
+}
+
+std::optional<Container> containerByName(const std::string& name) {
+  for (size_t i = 0; i < container_count; ++i) {
+    if (name == containerName(static_cast<Container>(i))) {
+      return static_cast<Container>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+size_t MemoryUsage::allocatedBytes() const {
+  size_t bytes = 0;
+  for (const auto& container : containers) {
+    bytes += container.allocated_bytes;
+  }
+  return bytes;
+}
+
+std::string memoryReport(const MemoryUsage& usage) {
+  std::string report;
+  char line[128];
+  for (size_t i = 0; i < container_count; ++i) {
+    const ContainerUsage& container = usage.containers[i];
+    snprintf(line, sizeof(line),
+             "%-10s %7zu items %9zu B live %9zu B allocated %7zu evicted\n",
+             containerName(static_cast<Container>(i)), container.count,
+             container.live_bytes, container.allocated_bytes,
+             container.evicted);
+    report += line;
+  }
+  snprintf(line, sizeof(line), "%-10s %43zu B allocated\n", "total",
+           usage.allocatedBytes());
+  report += line;
+  return report;
+}
@@ -0,0 +1,67 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// The world's containers, in the order they are reported.
+enum class Container {
+  BOULDERS,
+  ENVELOPE,
+  BACKGROUND,
+  SPIDERS,
+  BULLETS,
+  SPITS,
+  DEBRIS,
+  COUNT,
+};
+
+constexpr size_t container_count = static_cast<size_t>(Container::COUNT);
+
+const char* containerName(Container container);
+std::optional<Container> containerByName(const std::string& name);
+
+struct ContainerUsage {
+  size_t count = 0;
+  size_t live_bytes = 0;       // count times the element size
+  size_t allocated_bytes = 0;  // what the container holds from the allocator
+  size_t evicted = 0;          // elements dropped to stay within the limit
+};
+
+struct MemoryUsage {
+  std::array<ContainerUsage, container_count> containers;
+
+  ContainerUsage& operator[](Container container) {
+    return containers[static_cast<size_t>(container)];
+  }
+  const ContainerUsage& operator[](Container container) const {
+    return containers[static_cast<size_t>(container)];
+  }
+  size_t allocatedBytes() const;
+};
+
+// Live bytes allowed per container, 0 for no limit.
+struct MemoryLimits {
+  std::array<size_t, container_count> bytes = {};
+
+  size_t& operator[](Container container) {
+    return bytes[static_cast<size_t>(container)];
+  }
+  size_t operator[](Container container) const {
+    return bytes[static_cast<size_t>(container)];
+  }
+  // Elements of `element_size` bytes a container may hold.
+  size_t maxCount(Container container, size_t element_size) const {
+    size_t limit = (*this)[container];
+    return limit ? std::max<size_t>(limit / element_size, 1) : SIZE_MAX;
+  }
+};
+
+// One line per container, e.g. for logs.
+std::string memoryReport(const MemoryUsage& usage);
+
+#endif  // MEMORY_H
@@ -0,0 +1,447 @@
+#include "perf.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+#include "alloc_tracker.h"
+#include "game.h"
+#include "replay.h"
+
+namespace {
+
+constexpr uint64_t simulation_warmup = 2000;
+constexpr uint64_t simulation_ticks = 20000;
+constexpr int simulation_repeats = 5;
+// Recorded games are short, so they are played back to back until this
+// many ticks have been timed.
+constexpr uint64_t replay_warmup = 1000;
+constexpr uint64_t replay_ticks = 20000;
+
+struct SimulationScenario {
+  const char* name;
+  int seed;
+  double startx;
+};
+
+// An invulnerable ship firing in bursts, near the start and where spiders
+// crowd the floor.
+constexpr SimulationScenario simulation_scenarios[] = {
+    {"cruise", 1, 0},
+    {"crowded", 2, 10000},
+};
+
+// Just enough JSON for the baseline: nested objects of numbers, flattened
+// into dotted keys such as "results.cruise.p99_ns".
+class JsonNumbers
+{
+ public:
+  explicit JsonNumbers(const std::string& text)
+      : text_(text) {}
+
+  std::optional<std::map<std::string, double>> parse() {
+    if (!object("")) {
+      return std::nullopt;
+    }
+    space();
+    if (pos_ != text_.size()) {
+      return std::nullopt;
+    }
+    return values_;
+  }
+
+ private:
+  void space() {
+    while (pos_ < text_.size() && isspace(text_[pos_])) {
+      ++pos_;
+    }
+  }
+
+  bool consume(char c) {
+    space();
+    if (pos_ < text_.size() && text_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  std::optional<std::string> string() {
+    if (!consume('"')) {
+      return std::nullopt;
+    }
+    size_t end = text_.find('"', pos_);
+    if (end == std::string::npos) {
+      return std::nullopt;
+    }
+    std::string result = text_.substr(pos_, end - pos_);
+    pos_ = end + 1;
+    return result;
+  }
+
+  bool object(const std::string& prefix) {
+    if (!consume('{')) {
+      return false;
+    }
+    if (consume('}')) {
+      return true;
+    }
+    do {
+      auto key = string();
+      if (!key || !consume(':')) {
+        return false;
+      }
+      std::string path = prefix.empty() ? *key : prefix + "." + *key;
+      space();
+      if (pos_ < text_.size() && text_[pos_] == '{') {
+        if (!object(path)) {
+          return false;
+        }
+        continue;
+      }
+      const char* start = text_.c_str() + pos_;
+      char* end = nullptr;
+      double value = strtod(start, &end);
+      if (end == start) {
+        return false;
+      }
+      pos_ += end - start;
+      values_[path] = value;
+    } while (consume(','));
+    return consume('}');
+  }
+
+ private:
+  const std::string& text_;
+  size_t pos_ = 0;
+  std::map<std::string, double> values_;
+};
+
+}  // namespace
+
+std::optional<PerfBaseline> PerfBaseline::load(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    return std::nullopt;
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  auto values = JsonNumbers(text.str()).parse();
+  if (!values) {
+    return std::nullopt;
+  }
+
+  PerfBaseline baseline;
+  for (const auto& [key, value] : *values) {
+    if (key == "tolerance.steps_per_second") {
+      baseline.tolerance.steps_per_second = value;
+    } else if (key == "tolerance.p99_ns") {
+      baseline.tolerance.p99_ns = value;
+    } else if (key == "tolerance.allocations_per_step") {
+      baseline.tolerance.allocations_per_step = value;
+    } else if (key.rfind("results.", 0) == 0) {
+      size_t dot = key.rfind('.');
+      std::string name = key.substr(8, dot - 8);
+      std::string field = key.substr(dot + 1);
+      PerfResult& result = baseline.results[name];
+      result.name = name;
+      if (field == "steps_per_second") {
+        result.steps_per_second = value;
+      } else if (field == "p99_ns") {
+        result.p99_ns = value;
+      } else if (field == "allocations_per_step") {
+        result.allocations_per_step = value;
+      }
+    }
+  }
+  return baseline;
+}
+
+bool PerfBaseline::save(const std::string& path) const {
+  std::ofstream file(path);
+  char line[256];
+  snprintf(line, sizeof(line),
+           "{\n"
+           "  \"tolerance\": {\n"
+           "    \"steps_per_second\": %g,\n"
+           "    \"p99_ns\": %g,\n"
+           "    \"allocations_per_step\": %g\n"
+           "  },\n"
+           "  \"results\": {",
+           tolerance.steps_per_second, tolerance.p99_ns,
+           tolerance.allocations_per_step);
+  file << line;
+  const char* separator = "\n";
+  for (const auto& [name, result] : results) {
+    snprintf(line, sizeof(line),
+             "%s    \"%s\": {\"steps_per_second\": %.0f, \"p99_ns\": %.0f, "
+             "\"allocations_per_step\": %g}",
+             separator, name.c_str(), result.steps_per_second, result.p99_ns,
+             result.allocations_per_step);
+    file << line;
+    separator = ",\n";
+  }
+  file << "\n  }\n}\n";
+  return file.good();
+}
+
+PerfResult measurePerf(const std::string& name, uint64_t warmup,
+                       uint64_t steps, int repeats,
+                       const std::function<PerfStep()>& setup) {
+  PerfResult best = {.name = name};
+  std::vector<double> costs(steps);
+  for (int repeat = 0; repeat < repeats; ++repeat) {
+    PerfStep step = setup();
+    for (uint64_t i = 0; i < warmup; ++i) {
+      step();
+    }
+
+    uint64_t allocations = allocationCounts().allocations;
+    auto start = std::chrono::steady_clock::now();
+    auto step_start = start;
+    for (uint64_t i = 0; i < steps; ++i) {
+      step();
+      auto now = std::chrono::steady_clock::now();
+      costs[i] = std::chrono::duration<double, std::nano>(now - step_start)
+                     .count();
+      step_start = now;
+    }
+    std::chrono::duration<double> wall = step_start - start;
+    allocations = allocationCounts().allocations - allocations;
+
+    std::nth_element(costs.begin(), costs.begin() + steps * 99 / 100,
+                     costs.end());
+    PerfResult result = {
+        .name = name,
+        .steps_per_second = steps / wall.count(),
+        .p99_ns = costs[steps * 99 / 100],
+        .allocations_per_step = static_cast<double>(allocations) / steps,
+    };
+    if (repeat == 0 || result.steps_per_second > best.steps_per_second) {
+      best.steps_per_second = result.steps_per_second;
+    }
+    if (repeat == 0 || result.p99_ns < best.p99_ns) {
+      best.p99_ns = result.p99_ns;
+    }
+    if (repeat == 0 ||
+        result.allocations_per_step < best.allocations_per_step) {
+      best.allocations_per_step = result.allocations_per_step;
+    }
+  }
+  return best;
+}
+
+std::vector<PerfResult> medianPerf(
+    const std::vector<std::vector<PerfResult>>& runs) {
+  std::vector<PerfResult> results;
+  if (runs.empty()) {
+    return results;
+  }
+  auto median = [](std::vector<double> values) {
+    std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                     values.end());
+    return values[values.size() / 2];
+  };
+  for (size_t i = 0; i < runs[0].size(); ++i) {
+    std::vector<double> steps_per_second, p99_ns, allocations_per_step;
+    for (const auto& run : runs) {
+      steps_per_second.push_back(run[i].steps_per_second);
+      p99_ns.push_back(run[i].p99_ns);
+      allocations_per_step.push_back(run[i].allocations_per_step);
+    }
+    results.push_back({
+        .name = runs[0][i].name,
+        .steps_per_second = median(steps_per_second),
+        .p99_ns = median(p99_ns),
+        .allocations_per_step = median(allocations_per_step),
+    });
+  }
+  return results;
+}
+
+std::vector<PerfResult> bestPerf(const std::vector<PerfResult>& a,
+                                 const std::vector<PerfResult>& b) {
+  std::vector<PerfResult> results = a;
+  for (size_t i = 0; i < results.size() && i < b.size(); ++i) {
+    results[i].steps_per_second =
+        std::max(results[i].steps_per_second, b[i].steps_per_second);
+    results[i].p99_ns = std::min(results[i].p99_ns, b[i].p99_ns);
+    results[i].allocations_per_step =
+        std::min(results[i].allocations_per_step, b[i].allocations_per_step);
+  }
+  return results;
+}
+
+std::vector<PerfResult> runSimulationPerf() {
+  std::vector<PerfResult> results;
+  for (const auto& scenario : simulation_scenarios) {
+    results.push_back(measurePerf(
+        scenario.name, simulation_warmup, simulation_ticks,
+        simulation_repeats, [&]() -> PerfStep {
+          auto game = std::make_shared<Game>(scenario.seed, scenario.startx);
+          game->started = true;
+          game->invulnerable = true;
+          auto tick = std::make_shared<uint64_t>(0);
+          return [game, tick]() {
+            CommandMask commands = ++*tick % 40 < 20
+                                       ? commandBit(Command::FIRE)
+                                       : CommandMask(0);
+            game->step(commands, default_tick_ms);
+          };
+        }));
+  }
+  return results;
+}
+
+std::optional<PerfResult> measureReplayPerf(const std::string& path) {
+  auto replay = Replay::load(path);
+  if (!replay || replay->commands.empty() || replay->states.empty()) {
+    return std::nullopt;
+  }
+  auto shared = std::make_shared<const Replay>(std::move(*replay));
+  {
+    Game game(shared->seed, shared->startx);
+    ReplayPlayer player(*shared);
+    while (player.step(game)) {
+    }
+    if (player.divergence()) {
+      fprintf(stderr, "Replay %s %s\n", path.c_str(),
+              divergenceReport(*player.divergence()).c_str());
+      return std::nullopt;
+    }
+  }
+  // "perf/random_157.hssr" is "replay:random_157"
+  size_t slash = path.find_last_of("/\\");
+  std::string stem = path.substr(slash == std::string::npos ? 0 : slash + 1);
+  stem = stem.substr(0, stem.rfind('.'));
+  return measurePerf(
+      "replay:" + stem, replay_warmup, replay_ticks, simulation_repeats,
+      [shared]() -> PerfStep {
+        // playthroughs after the first restore the game from a snapshot of
+        // its start, which reuses its memory instead of making a new game
+        auto game = std::make_shared<Game>(shared->seed, shared->startx);
+        auto start = std::make_shared<Snapshot>();
+        game->snapshot(*start);
+        auto player = std::make_shared<std::optional<ReplayPlayer>>();
+        player->emplace(*shared);
+        return [shared, game, start, player]() {
+          if ((*player)->done()) {
+            game->restore(*start);
+            player->emplace(*shared);
+          }
+          (*player)->step(*game);
+        };
+      });
+}
+
+int runPerfGate(const std::string& path, bool update,
+                const PerfMeasure& measure) {
+  auto baseline = PerfBaseline::load(path);
+  if (!baseline && !update) {
+    fprintf(stderr, "Could not read baseline %s\n", path.c_str());
+    return 1;
+  }
+  if (!baseline) {
+    baseline.emplace();
+  }
+
+  std::vector<std::string> failures;
+  if (update) {
+    std::vector<std::vector<PerfResult>> runs;
+    for (int run = 0; run < perf_update_runs; ++run) {
+      auto results = measure();
+      if (!results) {
+        return 1;
+      }
+      runs.push_back(*results);
+    }
+    std::vector<PerfResult> results = medianPerf(runs);
+    for (const auto& result : results) {
+      baseline->results[result.name] = result;
+    }
+    if (!baseline->save(path)) {
+      fprintf(stderr, "Could not write baseline %s\n", path.c_str());
+      return 1;
+    }
+    printf("%s", perfReport(results, *baseline, failures).c_str());
+    return 0;
+  }
+
+  std::vector<PerfResult> best;
+  std::string report;
+  for (int attempt = 0; attempt < perf_attempts; ++attempt) {
+    auto results = measure();
+    if (!results) {
+      return 1;
+    }
+    best = attempt == 0 ? *results : bestPerf(best, *results);
+    failures.clear();
+    report = perfReport(best, *baseline, failures);
+    if (failures.empty()) {
+      break;
+    }
+    if (attempt + 1 < perf_attempts) {
+      printf("%sretrying\n", report.c_str());
+    }
+  }
+  printf("%s", report.c_str());
+  return failures.empty() ? 0 : 1;
+}
+
+std::string perfReport(const std::vector<PerfResult>& results,
+                       const PerfBaseline& baseline,
+                       std::vector<std::string>& failures) {
+  const PerfTolerance& tolerance = baseline.tolerance;
+  std::string report;
+  char line[256];
+  for (const auto& result : results) {
+    auto it = baseline.results.find(result.name);
+    if (it == baseline.results.end()) {
+      snprintf(line, sizeof(line),
+               "%s: %.0f steps/s, p99 %.0f ns, %.2f allocations/step\n",
+               result.name.c_str(), result.steps_per_second, result.p99_ns,
+               result.allocations_per_step);
+      report += line;
+      failures.push_back(result.name +
+                         ": no baseline, record one with --perf-update");
+      continue;
+    }
+    const PerfResult& base = it->second;
+    snprintf(line, sizeof(line),
+             "%s: %.0f steps/s (baseline %.0f), p99 %.0f ns (%.0f)",
+             result.name.c_str(), result.steps_per_second,
+             base.steps_per_second, result.p99_ns, base.p99_ns);
+    report += line;
+    if (allocationTrackingEnabled()) {
+      snprintf(line, sizeof(line), ", %.2f allocations/step (%.2f)",
+               result.allocations_per_step, base.allocations_per_step);
+      report += line;
+    }
+    report += "\n";
+
+    if (result.steps_per_second <
+        base.steps_per_second * (1 - tolerance.steps_per_second)) {
+      failures.push_back(result.name + ": steps per second dropped");
+    }
+    if (result.p99_ns > base.p99_ns * (1 + tolerance.p99_ns)) {
+      failures.push_back(result.name + ": p99 step time rose");
+    }
+    if (allocationTrackingEnabled() &&
+        result.allocations_per_step >
+            base.allocations_per_step + tolerance.allocations_per_step) {
+      failures.push_back(result.name + ": allocations per step rose");
+    }
+  }
+  for (const auto& failure : failures) {
+    report += "FAIL: " + failure + "\n";
+  }
+  if (failures.empty()) {
+    report += "PASS\n";
+  }
+  return report;
+}
@@ -0,0 +1,80 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+// One timed scenario; a step is a simulation tick or a drawn frame.
+struct PerfResult {
+  std::string name;
+  double steps_per_second = 0;
+  double p99_ns = 0;
+  double allocations_per_step = 0;  // only measured with allocation tracking
+};
+
+// Allowed slack before a result counts as a regression.
+struct PerfTolerance {
+  double steps_per_second = 0.25;  // fraction it may drop by
+  double p99_ns = 0.5;             // fraction it may rise by
+  double allocations_per_step = 0;
+};
+
+struct PerfBaseline {
+  PerfTolerance tolerance;
+  std::map<std::string, PerfResult> results;
+
+  static std::optional<PerfBaseline> load(const std::string& path);
+  bool save(const std::string& path) const;
+};
+
+// Runs `warmup` untimed steps, then times `steps` of them. Every one of
+// the `repeats` runs starts from fresh state made by `setup`, and the best
+// run is kept to shed noise from the rest of the machine.
+using PerfStep = std::function<void()>;
+PerfResult measurePerf(const std::string& name, uint64_t warmup,
+                       uint64_t steps, int repeats,
+                       const std::function<PerfStep()>& setup);
+
+// Runs of every scenario that --perf-update takes the median of, so that
+// one lucky run can't set a baseline the gate then fails against.
+constexpr int perf_update_runs = 5;
+
+// Times the gate measures before it fails. The machine has slow spells
+// that last a whole scenario; a regression shows in every attempt.
+constexpr int perf_attempts = 3;
+
+// Per scenario, the median steps per second, p99 and allocations of `runs`.
+std::vector<PerfResult> medianPerf(
+    const std::vector<std::vector<PerfResult>>& runs);
+// Per scenario, the better of two runs' results.
+std::vector<PerfResult> bestPerf(const std::vector<PerfResult>& a,
+                                 const std::vector<PerfResult>& b);
+
+// The headless simulation scenarios, with fixed seeds.
+std::vector<PerfResult> runSimulationPerf();
+
+// Plays a recorded game back to back, named "replay:" and the file's stem,
+// checking its states every tick. Empty if the replay cannot be read, has no
+// states, or diverges on a first playthrough.
+std::optional<PerfResult> measureReplayPerf(const std::string& path);
+
+// Measures every scenario with `measure`, which is empty on error, and
+// prints the results against the baseline at `path`; returns the exit
+// code. With `update` the median of perf_update_runs goes into the
+// baseline instead, and otherwise perf_attempts are made before failing.
+using PerfMeasure = std::function<std::optional<std::vector<PerfResult>>()>;
+int runPerfGate(const std::string& path, bool update,
+                const PerfMeasure& measure);
+
+// One line per result against the baseline; fills `failures` with the
+// regressions. A result without a baseline fails too, so a new scenario
+// cannot pass unchecked.
+std::string perfReport(const std::vector<PerfResult>& results,
+                       const PerfBaseline& baseline,
+                       std::vector<std::string>& failures);
+
+#endif  // PERF_H
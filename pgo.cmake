@@ -0,0 +1,77 @@
+# Builds HSS twice with link time optimization, once as is and once with
+# profile guided optimization trained on the headless simulator, then
+# benchmarks one against the other.
+#
+#   cmake -DSOURCE_DIR=. -DBUILD_DIR=_pgo -P pgo.cmake
+#
+# Optional: -DCC=... -DCXX=... compilers, -DREPLAYS=dir of .hssr replays to
+# train on, -DTRAIN_DRAW=ON to train drawing too (needs a display).
+
+if(NOT SOURCE_DIR OR NOT BUILD_DIR)
+  message(FATAL_ERROR "Pass -DSOURCE_DIR=... and -DBUILD_DIR=...")
+endif()
+get_filename_component(SOURCE_DIR ${SOURCE_DIR} ABSOLUTE)
+get_filename_component(BUILD_DIR ${BUILD_DIR} ABSOLUTE)
+
+set(LTO_DIR ${BUILD_DIR}/lto)
+# both PGO stages share a build directory: GCC finds profiles by object path
+set(PGO_DIR ${BUILD_DIR}/lto-pgo)
+set(PROFILE_DIR ${BUILD_DIR}/profile)
+
+set(COMPILERS)
+if(CC)
+  list(APPEND COMPILERS -DCMAKE_C_COMPILER=${CC})
+endif()
+if(CXX)
+  list(APPEND COMPILERS -DCMAKE_CXX_COMPILER=${CXX})
+endif()
+
+function(run)
+  execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Failed (${result}): ${ARGN}")
+  endif()
+endfunction()
+
+function(build dir)
+  run(${CMAKE_COMMAND} -S ${SOURCE_DIR} -B ${dir} -DCMAKE_BUILD_TYPE=Release
+      -DHSS_LTO=ON -DHSS_PGO_DIR=${PROFILE_DIR} ${COMPILERS} ${ARGN})
+  run(${CMAKE_COMMAND} --build ${dir} --parallel)
+endfunction()
+
+message(STATUS "LTO build")
+build(${LTO_DIR} -DHSS_PGO=)
+
+message(STATUS "Instrumented build")
+file(REMOVE_RECURSE ${PROFILE_DIR})
+build(${PGO_DIR} -DHSS_PGO=GENERATE)
+
+message(STATUS "Training")
+# the perf scenarios, a long flight and random games, so that ticks see
+# generation, crowds and game overs
+run(${PGO_DIR}/headless --perf ${BUILD_DIR}/training.json --perf-update)
+run(${PGO_DIR}/headless --soak 0.25 --seed 3)
+run(${PGO_DIR}/headless --batch 64 --threads 1 --ticks 20000)
+if(REPLAYS)
+  file(GLOB replays ${REPLAYS}/*.hssr)
+  foreach(replay ${replays})
+    execute_process(COMMAND ${PGO_DIR}/headless --replay ${replay})
+  endforeach()
+endif()
+if(TRAIN_DRAW)
+  run(${PGO_DIR}/HSS --perf ${BUILD_DIR}/training.json --perf-update
+      WORKING_DIRECTORY ${SOURCE_DIR})
+endif()
+
+# Clang writes raw profiles that have to be merged first, GCC doesn't
+file(GLOB profiles ${PROFILE_DIR}/*.profraw)
+if(profiles)
+  run(llvm-profdata merge -output=${PROFILE_DIR}/hss.profdata ${profiles})
+endif()
+
+message(STATUS "Optimized build")
+build(${PGO_DIR} -DHSS_PGO=USE)
+
+message(STATUS "LTO against LTO plus PGO")
+run(${LTO_DIR}/headless --perf ${BUILD_DIR}/lto.json --perf-update)
+execute_process(COMMAND ${PGO_DIR}/headless --perf ${BUILD_DIR}/lto.json)
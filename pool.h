@@ -0,0 +1,156 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+enum class OverflowPolicy {
+  DROP_OLDEST,       // the oldest particle makes room for the new one
+  MERGE,             // the new particle is folded into the newest one
+  SHORTEN_LIFETIME,  // lifetimes shrink as the pool fills, then drop oldest
+};
+
+// Fixed-capacity FIFO of particles, allocated once. Particles need a `ttl`
+// member and a mergeParticle(T&, const T&) overload.
+template <typename T>
+class ParticlePool
+{
+ public:
+  template <bool Const>
+  class Iterator
+  {
+   public:
+    using Pool = std::conditional_t<Const, const ParticlePool, ParticlePool>;
+    using Ref = std::conditional_t<Const, const T&, T&>;
+
+    Iterator(Pool* pool, size_t i)
+        : pool_(pool)
+        , i_(i) {}
+
+    Ref operator*() const { return pool_->at(i_); }
+    auto operator->() const { return &pool_->at(i_); }
+    Iterator& operator++() {
+      ++i_;
+      return *this;
+    }
+    bool operator!=(const Iterator& other) const { return i_ != other.i_; }
+    bool operator==(const Iterator& other) const { return i_ == other.i_; }
+
+   private:
+    Pool* pool_;
+    size_t i_;
+  };
+
+ public:
+  explicit ParticlePool(size_t capacity,
+                        OverflowPolicy policy = OverflowPolicy::DROP_OLDEST)
+      : storage_(std::max<size_t>(capacity, 1))
+      , policy_(policy) {}
+
+  // Reallocates and empties the pool.
+  void configure(size_t capacity, OverflowPolicy policy) {
+    storage_ = std::vector<T>(std::max<size_t>(capacity, 1));
+    policy_ = policy;
+    head_ = 0;
+    count_ = 0;
+    high_water_ = 0;
+  }
+
+  void push_back(T particle) {
+    if (policy_ == OverflowPolicy::SHORTEN_LIFETIME) {
+      // past three quarters full, lifetimes scale down with the free space
+      size_t pressure = capacity() * 3 / 4;
+      if (count_ > pressure) {
+        particle.ttl *= static_cast<float>(capacity() - count_) /
+                        (capacity() - pressure);
+        ++shortened_;
+      }
+    }
+
+    if (count_ == capacity()) {
+      if (policy_ == OverflowPolicy::MERGE) {
+        mergeParticle(back(), particle);
+        ++merged_;
+        return;
+      }
+      pop_front();
+      ++dropped_;
+    }
+
+    at(count_) = particle;
+    ++count_;
+    high_water_ = std::max(high_water_, count_);
+  }
+
+  // Keeps the first `count` slots in order, e.g. to be filled in by a
+  // snapshot restore.
+  void resize(size_t count) {
+    head_ = 0;
+    count_ = std::min(count, capacity());
+  }
+
+  // Reallocates to `capacity` slots, raised to the size, keeping the
+  // particles in order, e.g. to hold the pool within a memory limit.
+  void shrink(size_t capacity) {
+    capacity = std::max<size_t>({capacity, count_, 1});
+    if (capacity >= this->capacity()) {
+      return;
+    }
+    std::vector<T> storage(capacity);
+    for (size_t i = 0; i < count_; ++i) {
+      storage[i] = at(i);
+    }
+    storage_.swap(storage);
+    head_ = 0;
+    high_water_ = std::min(high_water_, capacity);
+  }
+
+  void pop_front() {
+    head_ = (head_ + 1) % capacity();
+    --count_;
+  }
+
+  T& front() { return at(0); }
+  const T& front() const { return at(0); }
+  T& back() { return at(count_ - 1); }
+  const T& back() const { return at(count_ - 1); }
+
+  Iterator<false> begin() { return {this, 0}; }
+  Iterator<false> end() { return {this, count_}; }
+  Iterator<true> begin() const { return {this, 0}; }
+  Iterator<true> end() const { return {this, count_}; }
+
+  bool empty() const { return count_ == 0; }
+  size_t size() const { return count_; }
+  size_t capacity() const { return storage_.size(); }
+  OverflowPolicy policy() const { return policy_; }
+
+  size_t highWater() const { return high_water_; }
+  size_t dropped() const { return dropped_; }
+  size_t merged() const { return merged_; }
+  size_t shortened() const { return shortened_; }
+
+ private:
+  // head_ + i wraps at most once; a compare is much cheaper than a modulo
+  size_t slot(size_t i) const {
+    size_t j = head_ + i;
+    return j < capacity() ? j : j - capacity();
+  }
+  T& at(size_t i) { return storage_[slot(i)]; }
+  const T& at(size_t i) const { return storage_[slot(i)]; }
+
+ private:
+  std::vector<T> storage_;
+  OverflowPolicy policy_;
+  size_t head_ = 0;
+  size_t count_ = 0;
+
+  size_t high_water_ = 0;
+  size_t dropped_ = 0;
+  size_t merged_ = 0;
+  size_t shortened_ = 0;
+};
+
+#endif  // POOL_H
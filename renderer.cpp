@@ -2,9 +2,12 @@
 
 #include <allegro5/allegro_primitives.h>
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <iostream>
 
+#include "alloc_tracker.h"
 #include "util.h"
 
 Renderer::Renderer(int width, int height)
@@ -21,19 +24,52 @@ Pixel Renderer::toPixel(float x, float y) const {
           .y = static_cast<int16_t>(y * height_)};
 }
 
-void Renderer::draw(const Game& game) {
-  static std::uniform_real_distribution<float> d(0, 1);
+const DrawCounters& Renderer::counters() const { return counters_; }
 
-  float bg_offsetx = game.offsetx * 1.1 + (game.ship.x - game.offsetx) / 10.;
-  float bg_offsety = game.offsety;
-  float mp_offsetx = game.offsetx;
-  float mp_offsety = game.offsety;
+void Renderer::issued(uint32_t triangles) {
+  ++counters_.primitive_calls;
+  counters_.triangles += triangles;
+}
+
+// Allegro picks 10 * sqrt(radius) segments for a circle.
+uint32_t Renderer::circleTriangles(float radius) const {
+  return std::max(static_cast<uint32_t>(10 * std::sqrt(radius)), 2u);
+}
+
+TickBlend TickBlend::at(const Game& game) {
+  return {.offsetx = game.offsetx,
+          .offsety = game.offsety,
+          .shipx = game.ship.x,
+          .shipy = game.ship.y,
+          .origin = game.cave.origin()};
+}
 
-  if (game.ship.damaged_cooldown) {
+void Renderer::draw(const Game& game) { draw(game, TickBlend::at(game)); }
+
+void Renderer::draw(const Game& game, const TickBlend& from) {
+  AllocationScope scope(Subsystem::RENDERING);
+  counters_ = {};
+  auto blend = [&](float before, float after) {
+    return before + (after - before) * from.alpha;
+  };
+  // a rebase in the tick moved every position back by whole chunks
+  const float shift = (game.cave.origin() - from.origin) * chunk_width;
+  float offsetx = blend(from.offsetx - shift, game.offsetx);
+  float offsety = blend(from.offsety, game.offsety);
+  Ship ship = game.ship;
+  ship.x = blend(from.shipx - shift, game.ship.x);
+  ship.y = blend(from.shipy, game.ship.y);
+
+  float bg_offsetx = offsetx * 1.1 + (ship.x - offsetx) / 10.;
+  float bg_offsety = offsety;
+  float mp_offsetx = offsetx;
+  float mp_offsety = offsety;
+
+  if (ship.damaged_cooldown) {
     mp_offsety +=
-        (d(random_generator_) - 0.5) * game.ship.damaged_cooldown / 1000;
+        (d_unit_(random_generator_) - 0.5) * ship.damaged_cooldown / 1000;
     mp_offsetx +=
-        (d(random_generator_) - 0.5) * game.ship.damaged_cooldown / 1000;
+        (d_unit_(random_generator_) - 0.5) * ship.damaged_cooldown / 1000;
   }
 
   auto prevbg = game.cave.background.begin();
@@ -50,7 +86,7 @@ void Renderer::draw(const Game& game) {
     drawBoulder(boulder, mp_offsetx, mp_offsety);
 
     if (game.debug) {
-      if (game.ship.x - 0.1 < x && x < game.ship.x + 0.1) {
+      if (ship.x - 0.1 < x && x < ship.x + 0.1) {
         drawBoulderOutline(boulder, mp_offsetx, mp_offsety, {0, 0, 255});
       }
     }
@@ -69,8 +105,9 @@ void Renderer::draw(const Game& game) {
 
   if (game.debug) {
     if (!game.collisions.empty()) {
-      Pixel bc = toPixel(game.ship.x - mp_offsetx, game.ship.y - mp_offsety);
-      al_draw_circle(bc.x, bc.y, game.ship.r * height_, {255, 0, 255, 255}, 2);
+      Pixel bc = toPixel(ship.x - mp_offsetx, ship.y - mp_offsety);
+      al_draw_circle(bc.x, bc.y, ship.r * height_, {255, 0, 255, 255}, 2);
+      issued(2 * circleTriangles(ship.r * height_));
     }
 
     for (auto& boulder : game.collisions) {
@@ -80,6 +117,7 @@ void Renderer::draw(const Game& game) {
       drawBoulderOutline(boulder, mp_offsetx, mp_offsety, {255, 255, 255});
       Pixel bc = toPixel(boulder.x - mp_offsetx, boulder.y - mp_offsety);
       al_draw_circle(bc.x, bc.y, boulder.r * height_, {255, 255, 0, 255}, 2);
+      issued(2 * circleTriangles(boulder.r * height_));
     }
   }
 
@@ -90,7 +128,7 @@ void Renderer::draw(const Game& game) {
     drawSpider(spider, mp_offsetx, mp_offsety);
   }
   if (!game.gameover) {
-    drawShip(game.ship, mp_offsetx, mp_offsety);
+    drawShip(ship, mp_offsetx, mp_offsety);
   }
 
   for (auto& bullet : game.cave.bullets) {
@@ -104,7 +142,7 @@ void Renderer::draw(const Game& game) {
     }
   }
 
-  drawHealth(game.ship, ship_max_health);
+  drawHealth(ship, ship_max_health);
 }
 
 void Renderer::drawShip(const Ship& ship, float offsetx, float offsety) {
@@ -115,22 +153,26 @@ void Renderer::drawShip(const Ship& ship, float offsetx, float offsety) {
     Pixel pc = toPixel(ship.x - offsetx + 0.053 * ship_size,
                        ship.y - offsety + 0.026 * ship_size);
     al_draw_filled_circle(pc.x, pc.y, 0.233 * ship_size * height_, hull_color);
+    issued(circleTriangles(0.233 * ship_size * height_));
   }
   {
     Pixel pc = toPixel(ship.x - offsetx + 0.324 * ship_size,
                        ship.y - offsety + 0.129 * ship_size);
     al_draw_filled_circle(pc.x, pc.y, 0.175 * ship_size * height_, hull_color);
+    issued(circleTriangles(0.175 * ship_size * height_));
   }
 
   {
     Pixel pc = toPixel(ship.x - offsetx - 0.234 * ship_size,
                        ship.y - offsety - 0.175 * ship_size);
     al_draw_filled_circle(pc.x, pc.y, 0.230 * ship_size * height_, hull_color);
+    issued(circleTriangles(0.230 * ship_size * height_));
   }
   {
     Pixel pc = toPixel(ship.x - offsetx - 0.118 * ship_size,
                        ship.y - offsety - 0.203 * ship_size);
     al_draw_filled_circle(pc.x, pc.y, 0.230 * ship_size * height_, hull_color);
+    issued(circleTriangles(0.230 * ship_size * height_));
   }
 
   {
@@ -141,9 +183,11 @@ void Renderer::drawShip(const Ship& ship, float offsetx, float offsety) {
     Pixel pc = toPixel(ship.x - offsetx - 0.419 * ship_size,
                        ship.y - offsety + 0.462 * ship_size);
     al_draw_filled_triangle(pa.x, pa.y, pb.x, pb.y, pc.x, pc.y, hull_color);
+    issued(1);
     Pixel pd = toPixel(ship.x - offsetx - 0.384 * ship_size,
                        ship.y - offsety + 0.305 * ship_size);
     al_draw_filled_triangle(pa.x, pa.y, pb.x, pb.y, pd.x, pd.y, hull_color);
+    issued(1);
   }
 }
 
@@ -156,6 +200,7 @@ void Renderer::drawBullet(const Bullet& bullet, float offsetx, float offsety) {
   Pixel pc = toPixel(bullet.x - offsetx - bullet.vx * 0.025,
                      bullet.y - offsety - bullet.vy * 0.025);
   al_draw_filled_triangle(pa.x, pa.y, pb.x, pb.y, pc.x, pc.y, bullet_color);
+  issued(1);
 }
 
 void Renderer::drawDebris(const Debris& debris, float offsetx, float offsety) {
@@ -167,6 +212,7 @@ void Renderer::drawDebris(const Debris& debris, float offsetx, float offsety) {
   al_draw_filled_triangle(
       pa.x, pa.y, pb.x, pb.y, pc.x, pc.y,
       al_map_rgb(15 + debris.shade, 10 + debris.shade, debris.shade));
+  issued(1);
 }
 
 void Renderer::drawBoulder(const Boulder& boulder, float offsetx,
@@ -184,6 +230,7 @@ void Renderer::drawBoulder(const Boulder& boulder, float offsetx,
     Pixel pc = toPixel(boulder.x - offsetx, boulder.y - offsety);
 
     al_draw_filled_triangle(pa.x, pa.y, pb.x, pb.y, pc.x, pc.y, boulder_color);
+    issued(1);
   }
 }
 
@@ -200,6 +247,7 @@ void Renderer::drawBoulderOutline(const Boulder& boulder, float offsetx,
     Pixel pc = toPixel(boulder.x - offsetx, boulder.y - offsety);
 
     al_draw_triangle(pa.x, pa.y, pb.x, pb.y, pc.x, pc.y, boulder_color, 2);
+    issued(6);
   }
 }
 
@@ -208,6 +256,7 @@ void Renderer::drawSpider(const Spider& spider, float offsetx, float offsety) {
 
   Pixel pc = toPixel(spider.x - offsetx, spider.y - offsety);
   al_draw_filled_circle(pc.x, pc.y, spider.r * height_, spider_color);
+  issued(circleTriangles(spider.r * height_));
 }
 
 void Renderer::drawSpit(const Spit& spit, float offsetx, float offsety) {
@@ -215,9 +264,10 @@ void Renderer::drawSpit(const Spit& spit, float offsetx, float offsety) {
 
   Pixel pc = toPixel(spit.x - offsetx, spit.y - offsety);
   al_draw_filled_circle(pc.x, pc.y, spit.r * height_, spit_color);
+  issued(circleTriangles(spit.r * height_));
 }
 
-void Renderer::drawEnvelope(const std::map<float, float>& envelope,
+void Renderer::drawEnvelope(const FlatMap<float, float>& envelope,
                             float offsetx, float offsety) {
   if (envelope.size() < 2) {
     return;
@@ -231,6 +281,7 @@ void Renderer::drawEnvelope(const std::map<float, float>& envelope,
     Pixel pa = toPixel(lx - offsetx, ly - offsety);
     Pixel pb = toPixel(x - offsetx, y - offsety);
     al_draw_line(pa.x, pa.y, pb.x, pb.y, {255, 0, 0, 255}, 2);
+    issued(2);
     lx = x;
     ly = y;
   }
@@ -242,21 +293,24 @@ void Renderer::drawBackgroundLine(const BackgroundLine& prev,
   if (next.vertices.size() < 2) {
     return;
   }
-  std::vector<float> vertices;
+  // both lines' points, x and y interleaved
+  std::array<float, background_line_max_vertices * 4> vertices;
+  size_t count = 0;
   for (auto vertex : prev.vertices) {
     Pixel p = toPixel(vertex.x - offsetx, vertex.y - offsety);
-    vertices.push_back(p.x);
-    vertices.push_back(p.y);
+    vertices[count++] = p.x;
+    vertices[count++] = p.y;
   }
   // for (auto vertex : next.vertices | std::views::reverse) {
   for (auto it = next.vertices.rbegin(); it != next.vertices.rend(); ++it) {
     Pixel p = toPixel(it->x - offsetx, it->y - offsety);
-    vertices.push_back(p.x);
-    vertices.push_back(p.y);
+    vertices[count++] = p.x;
+    vertices[count++] = p.y;
   }
   ALLEGRO_COLOR bg_color =
       al_map_rgb(10 + next.shade / 2, 5 + next.shade / 2, next.shade / 2);
-  al_draw_filled_polygon(vertices.data(), vertices.size() / 2, bg_color);
+  al_draw_filled_polygon(vertices.data(), count / 2, bg_color);
+  issued(count / 2 - 2);
 }
 
 void Renderer::drawHealth(const Ship& ship, int max_health) {
@@ -269,4 +323,5 @@ void Renderer::drawHealth(const Ship& ship, int max_health) {
   Pixel pb = toPixel(0.5 * ratio + frac / 2., 0.01);
 
   al_draw_filled_rectangle(pa.x, pa.y, pb.x, pb.y, health_color);
+  issued(2);
 }
@@ -11,6 +11,29 @@ struct Pixel {
   int16_t x, y;
 };
 
+// The camera and the ship as of the tick before the one drawn, and how far
+// the frame shown lies from there to the drawn tick, 0 to 1. Only these
+// are blended; everything else is drawn as of the drawn tick, so a frame
+// needs no copy of the game and shows no input the ticks haven't applied.
+struct TickBlend {
+  float offsetx = 0;
+  float offsety = 0;
+  float shipx = 0;
+  float shipy = 0;
+  // Cave::origin(), to undo a rebase between the ticks
+  int64_t origin = 0;
+  float alpha = 1;
+
+  static TickBlend at(const Game& game);
+};
+
+// What the last draw issued to Allegro. Triangle counts of circles, lines
+// and outlines are estimates of how Allegro tessellates them.
+struct DrawCounters {
+  uint32_t primitive_calls = 0;
+  uint32_t triangles = 0;
+};
+
 class Renderer
 {
  public:
@@ -18,8 +41,10 @@ class Renderer
   void reset(int width, int height);
 
   void draw(const Game& game);
+  void draw(const Game& game, const TickBlend& from);
 
   Pixel toPixel(float x, float y) const;
+  const DrawCounters& counters() const;
 
  private:
   void drawShip(const Ship& ship, float offsetx, float offsety);
@@ -30,18 +55,23 @@ class Renderer
                           std::array<uint8_t, 3> color);
   void drawSpider(const Spider& spider, float offsetx, float offsety);
   void drawSpit(const Spit& spit, float offsetx, float offsety);
-  void drawEnvelope(const std::map<float, float>& envelope, float offsetx,
+  void drawEnvelope(const FlatMap<float, float>& envelope, float offsetx,
                     float offsety);
   void drawBackgroundLine(const BackgroundLine& prev,
                           const BackgroundLine& next, float offsetx,
                           float offsety);
   void drawHealth(const Ship& ship, int max_health);
 
+  void issued(uint32_t triangles);
+  uint32_t circleTriangles(float radius) const;
+
  private:
   int width_;
   int height_;
+  DrawCounters counters_;
 
   std::default_random_engine random_generator_;
+  std::uniform_real_distribution<float> d_unit_{0, 1};
 };
 
 #endif // RENDERER_H
@@ -0,0 +1,184 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+const char replay_magic[4] = {'H', 'S', 'S', 'R'};
+
+void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+bool getVarint(const std::vector<uint8_t>& in, size_t& pos, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (pos >= in.size()) {
+      return false;
+    }
+    uint8_t byte = in[pos++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t zigzag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+}  // namespace
+
+void Replay::record(const Game& game, CommandMask commands) {
+  if (game.started && start_tick > this->commands.size()) {
+    start_tick = this->commands.size();
+  }
+  this->commands.push_back(commands);
+}
+
+void Replay::recordState(const Game& game) {
+  states.push_back(game.stateHash().digest());
+}
+
+std::vector<uint8_t> Replay::encode() const {
+  std::vector<uint8_t> out(std::begin(replay_magic), std::end(replay_magic));
+  putVarint(out, replay_version);
+  putVarint(out, zigzag(seed));
+  putVarint(out, std::bit_cast<uint64_t>(startx));
+  putVarint(out, tick_ms);
+  putVarint(out, start_tick);
+  putVarint(out, commands.size());
+
+  size_t i = 0;
+  while (i < commands.size()) {
+    size_t run = 1;
+    while (i + run < commands.size() && commands[i + run] == commands[i]) {
+      ++run;
+    }
+    putVarint(out, run);
+    out.push_back(commands[i]);
+    i += run;
+  }
+
+  putVarint(out, states.size());
+  for (const StateDigest& state : states) {
+    for (int shift = 0; shift < 64; shift += 8) {
+      out.push_back(static_cast<uint8_t>(state.combined >> shift));
+    }
+    out.insert(out.end(), state.sections.begin(), state.sections.end());
+  }
+
+  return out;
+}
+
+std::optional<Replay> Replay::decode(const std::vector<uint8_t>& data) {
+  if (data.size() < sizeof(replay_magic) ||
+      !std::equal(std::begin(replay_magic), std::end(replay_magic),
+                  data.begin())) {
+    return std::nullopt;
+  }
+
+  size_t pos = sizeof(replay_magic);
+  uint64_t version, seed, startx, tick_ms, start_tick, tick_count;
+  if (!getVarint(data, pos, version) || version != replay_version ||
+      !getVarint(data, pos, seed) || !getVarint(data, pos, startx) ||
+      !getVarint(data, pos, tick_ms) ||
+      !getVarint(data, pos, start_tick) || !getVarint(data, pos, tick_count)) {
+    return std::nullopt;
+  }
+
+  Replay replay;
+  replay.seed = static_cast<int>(unzigzag(seed));
+  replay.startx = std::bit_cast<double>(startx);
+  replay.tick_ms = tick_ms;
+  replay.start_tick = start_tick;
+  while (replay.commands.size() < tick_count) {
+    uint64_t run;
+    if (!getVarint(data, pos, run) || pos >= data.size() ||
+        run > tick_count - replay.commands.size()) {
+      return std::nullopt;
+    }
+    replay.commands.insert(replay.commands.end(), run, data[pos++]);
+  }
+
+  constexpr size_t digest_size = 8 + state_section_count;
+  uint64_t state_count;
+  if (!getVarint(data, pos, state_count) || state_count > tick_count ||
+      (data.size() - pos) / digest_size < state_count) {
+    return std::nullopt;
+  }
+  replay.states.resize(state_count);
+  for (StateDigest& state : replay.states) {
+    for (int shift = 0; shift < 64; shift += 8) {
+      state.combined |= static_cast<uint64_t>(data[pos++]) << shift;
+    }
+    std::copy_n(data.begin() + pos, state_section_count,
+                state.sections.begin());
+    pos += state_section_count;
+  }
+  return replay;
+}
+
+bool Replay::save(const std::string& path) const {
+  std::vector<uint8_t> data = encode();
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(data.data()), data.size());
+  return file.good();
+}
+
+std::optional<Replay> Replay::load(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return std::nullopt;
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  return decode(data);
+}
+
+ReplayPlayer::ReplayPlayer(const Replay& replay)
+    : replay_(replay) {}
+
+bool ReplayPlayer::step(Game& game) {
+  if (done()) {
+    return false;
+  }
+  if (tick_ == replay_.start_tick) {
+    game.started = true;
+  }
+  game.step(replay_.commands[tick_], replay_.tick_ms);
+  if (!divergence_ && tick_ < replay_.states.size()) {
+    StateDigest actual = game.stateHash().digest();
+    if (actual != replay_.states[tick_]) {
+      divergence_ = {tick_, replay_.states[tick_], actual};
+    }
+  }
+  ++tick_;
+  return true;
+}
+
+bool ReplayPlayer::done() const { return tick_ >= replay_.commands.size(); }
+
+size_t ReplayPlayer::tick() const { return tick_; }
+
+const std::optional<Divergence>& ReplayPlayer::divergence() const {
+  return divergence_;
+}
+
+std::string divergenceReport(const Divergence& divergence) {
+  return "diverged at tick " + std::to_string(divergence.tick) + " in " +
+         divergentSections(divergence.expected, divergence.actual);
+}
@@ -0,0 +1,73 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "game.h"
+#include "state_hash.h"
+
+constexpr uint32_t replay_version = 5;
+constexpr uint32_t default_tick_ms = 16;
+
+// The inputs of a game: its seed, start position, the fixed tick length and
+// one CommandMask per tick. Serialized as run-length encoded masks with
+// varint counts, followed by the digest of the state after every tick, if
+// recorded.
+class Replay
+{
+ public:
+  // Before the tick that applies `commands`.
+  void record(const Game& game, CommandMask commands);
+  // After the tick.
+  void recordState(const Game& game);
+
+  std::vector<uint8_t> encode() const;
+  static std::optional<Replay> decode(const std::vector<uint8_t>& data);
+
+  bool save(const std::string& path) const;
+  static std::optional<Replay> load(const std::string& path);
+
+ public:
+  int seed = 0;
+  double startx = 0;  // where in the cave the game starts
+  uint32_t tick_ms = default_tick_ms;
+  // first tick at which the game was started
+  uint32_t start_tick = std::numeric_limits<uint32_t>::max();
+  std::vector<CommandMask> commands;
+  std::vector<StateDigest> states;
+};
+
+// First tick whose state differs from the one recorded.
+struct Divergence {
+  size_t tick;
+  StateDigest expected;
+  StateDigest actual;
+};
+
+// Drives a Game through a Replay tick by tick, exactly as the client did.
+class ReplayPlayer
+{
+ public:
+  explicit ReplayPlayer(const Replay& replay);
+
+  // Returns false once the replay is exhausted. Ticks with a recorded state
+  // are checked against it.
+  bool step(Game& game);
+  bool done() const;
+  size_t tick() const;
+  const std::optional<Divergence>& divergence() const;
+
+ private:
+  const Replay& replay_;
+  size_t tick_ = 0;
+  std::optional<Divergence> divergence_;
+};
+
+// E.g. "diverged at tick 12 in boulders, spiders".
+std::string divergenceReport(const Divergence& divergence);
+
+#endif  // REPLAY_H
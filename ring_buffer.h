@@ -0,0 +1,142 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+// FIFO on a power of two sized ring that doubles when full and never
+// shrinks, so that pushing and popping allocate nothing once it has grown
+// to the largest size it needs.
+template <typename T>
+class RingBuffer
+{
+ public:
+  template <bool Const>
+  class Iterator
+  {
+   public:
+    using Ring = std::conditional_t<Const, const RingBuffer, RingBuffer>;
+    using Ref = std::conditional_t<Const, const T&, T&>;
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, const T*, T*>;
+    using reference = Ref;
+
+    Iterator(Ring* ring, size_t i)
+        : ring_(ring)
+        , i_(i) {}
+
+    Ref operator*() const { return (*ring_)[i_]; }
+    auto operator->() const { return &(*ring_)[i_]; }
+    Iterator& operator++() {
+      ++i_;
+      return *this;
+    }
+    bool operator!=(const Iterator& other) const { return i_ != other.i_; }
+    bool operator==(const Iterator& other) const { return i_ == other.i_; }
+
+   private:
+    Ring* ring_;
+    size_t i_;
+  };
+
+ public:
+  void push_back(const T& value) {
+    if (count_ == capacity()) {
+      reserve(capacity() ? capacity() * 2 : 16);
+    }
+    (*this)[count_] = value;
+    ++count_;
+  }
+
+  void pop_front() {
+    head_ = (head_ + 1) & (capacity() - 1);
+    --count_;
+  }
+
+  void clear() {
+    head_ = 0;
+    count_ = 0;
+  }
+
+  void reserve(size_t capacity) {
+    if (capacity <= this->capacity()) {
+      return;
+    }
+    size_t rounded = 1;
+    while (rounded < capacity) {
+      rounded *= 2;
+    }
+    reallocate(rounded);
+  }
+
+  // Gives back storage beyond `capacity`, rounded up to a power of two and
+  // to the size, e.g. after a spike.
+  void shrink(size_t capacity) {
+    capacity = std::max(capacity, count_);
+    size_t rounded = 1;
+    while (rounded < capacity) {
+      rounded *= 2;
+    }
+    if (rounded < this->capacity()) {
+      reallocate(rounded);
+    }
+  }
+
+  // Largest capacity a ring can have within `count` elements.
+  static size_t capacityWithin(size_t count) {
+    size_t capacity = 1;
+    while (capacity * 2 <= count) {
+      capacity *= 2;
+    }
+    return capacity;
+  }
+
+  // Keeps `count` slots in order, e.g. to be filled in by a snapshot
+  // restore.
+  void resize(size_t count) {
+    reserve(count);
+    head_ = 0;
+    count_ = count;
+  }
+
+  T& operator[](size_t i) { return storage_[(head_ + i) & (capacity() - 1)]; }
+  const T& operator[](size_t i) const {
+    return storage_[(head_ + i) & (capacity() - 1)];
+  }
+
+  T& front() { return (*this)[0]; }
+  const T& front() const { return (*this)[0]; }
+  T& back() { return (*this)[count_ - 1]; }
+  const T& back() const { return (*this)[count_ - 1]; }
+
+  Iterator<false> begin() { return {this, 0}; }
+  Iterator<false> end() { return {this, count_}; }
+  Iterator<true> begin() const { return {this, 0}; }
+  Iterator<true> end() const { return {this, count_}; }
+
+  bool empty() const { return count_ == 0; }
+  size_t size() const { return count_; }
+  size_t capacity() const { return storage_.size(); }
+
+ private:
+  void reallocate(size_t capacity) {
+    std::vector<T> storage(capacity);
+    for (size_t i = 0; i < count_; ++i) {
+      storage[i] = (*this)[i];
+    }
+    storage_.swap(storage);
+    head_ = 0;
+  }
+
+ private:
+  std::vector<T> storage_;
+  size_t head_ = 0;
+  size_t count_ = 0;
+};
+
+#endif  // RING_BUFFER_H
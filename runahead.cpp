@@ -0,0 +1,41 @@
+#include "runahead.h"
+
+#include <chrono>
+
+RunAhead::RunAhead(int ticks)
+    : ticks_(ticks) {}
+
+const Game& RunAhead::predict(const Game& game, CommandMask held,
+                              uint32_t dt) {
+  if (ticks_ <= 0) {
+    return game;
+  }
+  if (!ahead_) {
+    ahead_.emplace();
+  }
+  auto start = std::chrono::steady_clock::now();
+  game.snapshot(snapshot_);
+  if (!ahead_->restore(snapshot_)) {
+    return game;
+  }
+  // not part of the simulation state, but drawn
+  ahead_->debug = game.debug;
+  auto copied = std::chrono::steady_clock::now();
+  for (int i = 0; i < ticks_; ++i) {
+    ahead_->step(held, dt);
+  }
+  auto stepped = std::chrono::steady_clock::now();
+
+  std::chrono::duration<double, std::nano> copy = copied - start;
+  std::chrono::duration<double, std::nano> steps = stepped - copied;
+  ++cost_.frames;
+  cost_.copy_ns += copy.count();
+  cost_.step_ns += steps.count();
+  return *ahead_;
+}
+
+int RunAhead::ticks() const { return ticks_; }
+
+const RunAheadCost& RunAhead::cost() const { return cost_; }
+
+void RunAhead::resetCost() { cost_ = {}; }
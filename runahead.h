@@ -0,0 +1,48 @@
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include <cstdint>
+#include <optional>
+
+#include "game.h"
+#include "snapshot.h"
+
+// CPU time run-ahead has spent, summed over the frames predicted.
+struct RunAheadCost {
+  uint64_t frames = 0;
+  double copy_ns = 0;  // snapshot and restore
+  double step_ns = 0;  // speculative ticks
+
+  double frameUs() const {
+    return frames ? (copy_ns + step_ns) / frames / 1000 : 0;
+  }
+};
+
+// Shows the game a few ticks in the future to hide display latency: a copy
+// of the real game is stepped ahead with the current input held, drawn,
+// then thrown away. It costs a copy of the whole state every frame, so the
+// client only does it when asked to with --run-ahead. Relies on snapshots
+// restoring the whole state and on ticks being deterministic, so that a
+// prediction whose input came true is exactly what the real game reaches.
+class RunAhead
+{
+ public:
+  explicit RunAhead(int ticks);
+
+  // `game` as it will be `ticks` of `dt` from now if `held` stays held.
+  // Valid until the next call; `game` itself is left as is, and returned
+  // when there is nothing to predict.
+  const Game& predict(const Game& game, CommandMask held, uint32_t dt);
+
+  int ticks() const;
+  const RunAheadCost& cost() const;
+  void resetCost();
+
+ private:
+  int ticks_;
+  Snapshot snapshot_;
+  std::optional<Game> ahead_;
+  RunAheadCost cost_;
+};
+
+#endif  // RUNAHEAD_H
@@ -0,0 +1,192 @@
+#include "seed_search.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "cave.h"
+
+namespace {
+
+constexpr float screen_width = 16.f / 9.f;
+constexpr uint32_t index_version = 1;
+
+// Lowest point of the boulders hanging from the upper half at x, using their
+// bounding circles.
+float ceilingAt(const Cave& cave, float x) {
+  float ceiling = 0;
+  auto it = cave.boulders.lower_bound(x - boulder_max_radius);
+  auto end = cave.boulders.upper_bound(x + boulder_max_radius);
+  for (; it != end; ++it) {
+    const Boulder& boulder = it->second;
+    float dx = x - boulder.x;
+    if (boulder.y >= 0.5 || fabs(dx) >= boulder.r) {
+      continue;
+    }
+    ceiling = std::max(ceiling,
+                       boulder.y + sqrtf(boulder.r * boulder.r - dx * dx));
+  }
+  return ceiling;
+}
+
+double metricValue(const SeedMetrics& metrics, SeedMetric metric) {
+  switch (metric) {
+    case SeedMetric::SEED:
+      return metrics.seed;
+    case SeedMetric::DENSITY:
+      return metrics.boulder_density;
+    case SeedMetric::FORMATIONS:
+      return metrics.formations;
+    case SeedMetric::SPIDERS:
+      return metrics.spiders;
+    case SeedMetric::GAP:
+      return metrics.narrowest_gap;
+    case SeedMetric::TRIANGLES:
+      return metrics.triangles;
+    case SeedMetric::PEAK_TRIANGLES:
+      return metrics.peak_triangles;
+  }
+  return 0;
+}
+
+}  // namespace
+
+std::optional<SeedMetric> seedMetric(const std::string& name) {
+  if (name == "seed") {
+    return SeedMetric::SEED;
+  } else if (name == "density") {
+    return SeedMetric::DENSITY;
+  } else if (name == "formations") {
+    return SeedMetric::FORMATIONS;
+  } else if (name == "spiders") {
+    return SeedMetric::SPIDERS;
+  } else if (name == "gap") {
+    return SeedMetric::GAP;
+  } else if (name == "triangles") {
+    return SeedMetric::TRIANGLES;
+  } else if (name == "peak_triangles") {
+    return SeedMetric::PEAK_TRIANGLES;
+  }
+  return std::nullopt;
+}
+
+SeedMetrics measureSeed(int seed, float length) {
+  Cave cave(seed);
+  for (int64_t chunk = 0; cave.chunkStart(chunk) < length; ++chunk) {
+    cave.generateChunk(chunk);
+  }
+
+  SeedMetrics metrics = {
+      .seed = seed,
+      .length = length,
+      .boulder_density = cave.stats.boulders / length,
+      .boulders = cave.stats.boulders,
+      .formations = cave.stats.formations,
+      .spiders = cave.stats.spiders,
+      .narrowest_gap = 1,
+      .narrowest_gap_x = 0,
+      .triangles = 0,
+      .peak_triangles = 0,
+  };
+
+  for (const auto& [x, floor] : cave.floor_envelope) {
+    float gap = floor - ceilingAt(cave, x);
+    if (gap < metrics.narrowest_gap) {
+      metrics.narrowest_gap = gap;
+      metrics.narrowest_gap_x = x;
+    }
+  }
+
+  // one fan triangle per boulder vertex, sliding a screen over the boulders
+  uint32_t on_screen = 0;
+  auto first = cave.boulders.begin();
+  for (auto it = cave.boulders.begin(); it != cave.boulders.end(); ++it) {
+    on_screen += it->second.vertices.size();
+    while (it->first - first->first > screen_width) {
+      on_screen -= first->second.vertices.size();
+      ++first;
+    }
+    metrics.triangles += it->second.vertices.size();
+    metrics.peak_triangles = std::max(metrics.peak_triangles, on_screen);
+  }
+  // background polygons join neighbouring lines
+  for (size_t i = 1; i < cave.background.size(); ++i) {
+    metrics.triangles += cave.background[i - 1].vertices.size() +
+                         cave.background[i].vertices.size() - 2;
+  }
+
+  return metrics;
+}
+
+std::vector<SeedMetrics> searchSeeds(int first_seed, size_t count,
+                                     float length, ThreadPool& pool) {
+  std::vector<SeedMetrics> metrics(count);
+  pool.parallelFor(count, [&](size_t i) {
+    metrics[i] = measureSeed(first_seed + i, length);
+  });
+  return metrics;
+}
+
+void sortSeeds(std::vector<SeedMetrics>& metrics, SeedMetric by,
+               bool descending) {
+  std::stable_sort(metrics.begin(), metrics.end(),
+                   [&](const SeedMetrics& a, const SeedMetrics& b) {
+                     double va = metricValue(a, by);
+                     double vb = metricValue(b, by);
+                     return descending ? va > vb : va < vb;
+                   });
+}
+
+std::string seedsCsv(const std::vector<SeedMetrics>& metrics) {
+  std::string csv =
+      "seed,length,density,boulders,formations,spiders,gap,gap_x,triangles,"
+      "peak_triangles\n";
+  char line[256];
+  for (const auto& m : metrics) {
+    snprintf(line, sizeof(line),
+             "%" PRId32 ",%.2f,%.2f,%" PRIu32 ",%" PRIu32 ",%" PRIu32
+             ",%.4f,%.3f,%" PRIu32 ",%" PRIu32 "\n",
+             m.seed, m.length, m.boulder_density, m.boulders, m.formations,
+             m.spiders, m.narrowest_gap, m.narrowest_gap_x, m.triangles,
+             m.peak_triangles);
+    csv += line;
+  }
+  return csv;
+}
+
+bool saveSeedIndex(const std::vector<SeedMetrics>& metrics,
+                   const std::string& path) {
+  std::ofstream file(path, std::ios::binary);
+  uint64_t count = metrics.size();
+  file.write("HSSI", 4);
+  file.write(reinterpret_cast<const char*>(&index_version),
+             sizeof(index_version));
+  file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  file.write(reinterpret_cast<const char*>(metrics.data()),
+             metrics.size() * sizeof(SeedMetrics));
+  return file.good();
+}
+
+std::optional<std::vector<SeedMetrics>> loadSeedIndex(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[4];
+  uint32_t version = 0;
+  uint64_t count = 0;
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(&version), sizeof(version));
+  file.read(reinterpret_cast<char*>(&count), sizeof(count));
+  if (!file || memcmp(magic, "HSSI", 4) != 0 || version != index_version) {
+    return std::nullopt;
+  }
+  std::vector<SeedMetrics> metrics(count);
+  file.read(reinterpret_cast<char*>(metrics.data()),
+            count * sizeof(SeedMetrics));
+  if (!file) {
+    return std::nullopt;
+  }
+  return metrics;
+}
@@ -0,0 +1,50 @@
+#ifndef SEED_SEARCH_H
+#define SEED_SEARCH_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+// What the first world units of a seed's cave look like, from generation
+// alone.
+struct SeedMetrics {
+  int32_t seed;
+  float length;
+  float boulder_density;  // boulders per world unit
+  uint32_t boulders;
+  uint32_t formations;
+  uint32_t spiders;
+  float narrowest_gap;  // between ceiling boulders and the floor envelope
+  float narrowest_gap_x;
+  uint32_t triangles;         // boulder fans and background polygons
+  uint32_t peak_triangles;    // most boulder triangles on one screen
+};
+
+enum class SeedMetric {
+  SEED,
+  DENSITY,
+  FORMATIONS,
+  SPIDERS,
+  GAP,
+  TRIANGLES,
+  PEAK_TRIANGLES,
+};
+
+std::optional<SeedMetric> seedMetric(const std::string& name);
+
+SeedMetrics measureSeed(int seed, float length);
+std::vector<SeedMetrics> searchSeeds(int first_seed, size_t count,
+                                     float length, ThreadPool& pool);
+void sortSeeds(std::vector<SeedMetrics>& metrics, SeedMetric by,
+               bool descending);
+
+std::string seedsCsv(const std::vector<SeedMetrics>& metrics);
+// Fixed size records behind a "HSSI" magic, version and count.
+bool saveSeedIndex(const std::vector<SeedMetrics>& metrics,
+                   const std::string& path);
+std::optional<std::vector<SeedMetrics>> loadSeedIndex(const std::string& path);
+
+#endif  // SEED_SEARCH_H
@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "seed_search.h"
+
+int main(int argc, char** argv) {
+  int first_seed = 0;
+  size_t count = 1000;
+  float length = 20;
+  size_t threads = std::thread::hardware_concurrency();
+  std::string sort = "seed";
+  size_t top = 0;
+  std::string csv_path;
+  std::string index_path;
+  std::string load_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--first" && i + 1 < argc) {
+      first_seed = std::stoi(argv[++i]);
+    } else if (arg == "--count" && i + 1 < argc) {
+      count = std::stoul(argv[++i]);
+    } else if (arg == "--length" && i + 1 < argc) {
+      length = std::stof(argv[++i]);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = std::stoul(argv[++i]);
+    } else if (arg == "--sort" && i + 1 < argc) {
+      sort = argv[++i];
+    } else if (arg == "--top" && i + 1 < argc) {
+      top = std::stoul(argv[++i]);
+    } else if (arg == "--csv" && i + 1 < argc) {
+      csv_path = argv[++i];
+    } else if (arg == "--index" && i + 1 < argc) {
+      index_path = argv[++i];
+    } else if (arg == "--load" && i + 1 < argc) {
+      load_path = argv[++i];
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--first SEED] [--count N] [--length UNITS]"
+                   " [--threads N]\n"
+                   "       [--load INDEX] [--sort [-]METRIC] [--top N]"
+                   " [--csv FILE] [--index FILE]\n"
+                   "metrics: seed density formations spiders gap triangles"
+                   " peak_triangles, - sorts descending"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  bool descending = !sort.empty() && sort[0] == '-';
+  auto metric = seedMetric(descending ? sort.substr(1) : sort);
+  if (!metric) {
+    std::cerr << "Unknown metric: " << sort << std::endl;
+    return 1;
+  }
+
+  std::vector<SeedMetrics> metrics;
+  if (!load_path.empty()) {
+    auto loaded = loadSeedIndex(load_path);
+    if (!loaded) {
+      std::cerr << "Could not read index " << load_path << std::endl;
+      return 1;
+    }
+    metrics = std::move(*loaded);
+  } else {
+    ThreadPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    metrics = searchSeeds(first_seed, count, length, pool);
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+    fprintf(stderr,
+            "%zu seeds of %.1f units on %zu threads in %.2f s (%.0f/s)\n",
+            count, length, pool.size(), wall.count(), count / wall.count());
+  }
+
+  sortSeeds(metrics, *metric, descending);
+  if (!index_path.empty() && !saveSeedIndex(metrics, index_path)) {
+    std::cerr << "Could not write index " << index_path << std::endl;
+    return 1;
+  }
+  if (top > 0 && top < metrics.size()) {
+    metrics.resize(top);
+  }
+
+  std::string csv = seedsCsv(metrics);
+  if (csv_path.empty()) {
+    printf("%s", csv.c_str());
+  } else {
+    std::ofstream file(csv_path);
+    file << csv;
+    if (!file) {
+      std::cerr << "Could not write " << csv_path << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
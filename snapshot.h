@@ -0,0 +1,158 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Flat copy of the world. Holds only trivially copyable values and offsets,
+// never pointers, so it can be moved or stored as plain bytes. Reading one
+// back checks its header and that it is neither truncated nor too long, but
+// trusts the values themselves: only the build that wrote a snapshot should
+// read it.
+struct Snapshot {
+  std::vector<uint8_t> data;
+};
+
+// Bumped whenever what a snapshot holds changes.
+constexpr uint32_t snapshot_version = 1;
+constexpr uint32_t snapshot_magic = 0x53535348;  // "HSSS"
+
+struct SnapshotHeader {
+  uint32_t magic = snapshot_magic;
+  uint32_t version = snapshot_version;
+  uint64_t layout = 0;  // see snapshotLayout()
+};
+
+// Fingerprint of the sizes of the types copied as raw bytes, so that a
+// snapshot from a build laying them out differently is refused.
+template <typename... T>
+constexpr uint64_t snapshotLayout() {
+  uint64_t layout = 0;
+  ((layout = layout * 1000003 + sizeof(T)), ...);
+  return layout;
+}
+
+class SnapshotWriter
+{
+ public:
+  // Reuses the capacity of a previous snapshot.
+  SnapshotWriter(Snapshot& snapshot, uint64_t layout)
+      : data_(snapshot.data) {
+    data_.clear();
+    write(SnapshotHeader{.layout = layout});
+  }
+
+  template <typename T>
+  void write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    writeBytes(&value, sizeof(T));
+  }
+
+  template <typename Container>
+  void writeRange(const Container& container) {
+    using T = std::decay_t<decltype(*container.begin())>;
+    static_assert(std::is_trivially_copyable_v<T>);
+    write<uint64_t>(container.size());
+    if constexpr (requires { container.data(); }) {
+      writeBytes(container.data(), container.size() * sizeof(T));
+    } else {
+      for (const T& value : container) {
+        write(value);
+      }
+    }
+  }
+
+ private:
+  void writeBytes(const void* bytes, size_t size) {
+    if (size == 0) {
+      return;
+    }
+    size_t pos = data_.size();
+    data_.resize(pos + size);
+    std::memcpy(data_.data() + pos, bytes, size);
+  }
+
+ private:
+  std::vector<uint8_t>& data_;
+};
+
+class SnapshotReader
+{
+ public:
+  // Fails unless the snapshot starts with a header of this version and
+  // `layout`.
+  SnapshotReader(const Snapshot& snapshot, uint64_t layout)
+      : data_(snapshot.data) {
+    auto header = read<SnapshotHeader>();
+    if (header.magic != snapshot_magic ||
+        header.version != snapshot_version || header.layout != layout) {
+      fail();
+    }
+  }
+
+  // Once a read has failed, the following ones leave their values as they
+  // are.
+  bool ok() const { return ok_; }
+  // Everything was read and nothing failed.
+  bool done() const { return ok_ && pos_ == data_.size(); }
+  void fail() { ok_ = false; }
+
+  template <typename T>
+  void read(T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    readBytes(&value, sizeof(T));
+  }
+
+  template <typename T>
+  T read() {
+    T value{};
+    read(value);
+    return value;
+  }
+
+  // The container must offer resize(n) followed by in-order iteration.
+  // Fails on counts the remaining bytes or the container cannot hold.
+  template <typename Container>
+  void readRange(Container& container) {
+    using T = std::decay_t<decltype(*container.begin())>;
+    auto count = read<uint64_t>();
+    if (!ok_ || count > (data_.size() - pos_) / sizeof(T)) {
+      fail();
+      return;
+    }
+    container.resize(count);
+    if (container.size() != count) {
+      fail();
+      return;
+    }
+    if constexpr (requires { container.data(); }) {
+      readBytes(container.data(), container.size() * sizeof(T));
+    } else {
+      for (T& value : container) {
+        read(value);
+      }
+    }
+  }
+
+ private:
+  void readBytes(void* bytes, size_t size) {
+    if (!ok_ || size > data_.size() - pos_) {
+      fail();
+      return;
+    }
+    if (size == 0) {
+      return;
+    }
+    std::memcpy(bytes, data_.data() + pos_, size);
+    pos_ += size;
+  }
+
+ private:
+  const std::vector<uint8_t>& data_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+#endif  // SNAPSHOT_H
@@ -0,0 +1,202 @@
+#include "soak.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "game.h"
+
+namespace {
+
+// samples before this fraction of the run are warm up
+constexpr double warmup = 0.1;
+// absolute slack on top of the tolerance, for containers that are tiny
+constexpr double count_slack = 16;
+constexpr double byte_slack = 4096;
+
+// Spiders, and so spits, get denser with distance by design.
+double crowding(const SoakSample& sample, Container container) {
+  if (container == Container::SPIDERS || container == Container::SPITS) {
+    return spiderProbability(sample.distance) / spiderProbability(0);
+  }
+  return 1;
+}
+
+template <typename Value>
+double peak(const std::vector<SoakSample>& samples, size_t from, size_t to,
+            Value value) {
+  double result = 0;
+  for (size_t i = from; i < to; ++i) {
+    result = std::max(result, value(samples[i]));
+  }
+  return result;
+}
+
+double median(const std::vector<SoakSample>& samples, size_t from, size_t to) {
+  std::vector<double> values;
+  for (size_t i = from; i < to; ++i) {
+    values.push_back(samples[i].ns_per_entity);
+  }
+  if (values.empty()) {
+    return 0;
+  }
+  std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                   values.end());
+  return values[values.size() / 2];
+}
+
+// Compares the second half of the run against the first one, after warm up.
+std::vector<std::string> checkGrowth(const std::vector<SoakSample>& samples,
+                                     double tolerance) {
+  std::vector<std::string> failures;
+  size_t first = samples.size() * warmup;
+  size_t middle = (first + samples.size()) / 2;
+  if (middle - first < 2) {
+    failures.push_back("too few samples to judge growth");
+    return failures;
+  }
+
+  char line[256];
+  for (size_t i = 0; i < container_count; ++i) {
+    auto container = static_cast<Container>(i);
+    auto count = [&](const SoakSample& sample) {
+      return sample.memory[container].count / crowding(sample, container);
+    };
+    auto bytes = [&](const SoakSample& sample) {
+      return sample.memory[container].allocated_bytes /
+             crowding(sample, container);
+    };
+    double early = peak(samples, first, middle, count);
+    double late = peak(samples, middle, samples.size(), count);
+    // the debris pool is bounded by its capacity, which spit hits fill faster
+    // as the cave gets crowded
+    if (container != Container::DEBRIS &&
+        late > early * tolerance + count_slack) {
+      snprintf(line, sizeof(line), "%s grew from %.0f to %.0f items",
+               containerName(container), early, late);
+      failures.push_back(line);
+    }
+    early = peak(samples, first, middle, bytes);
+    late = peak(samples, middle, samples.size(), bytes);
+    if (late > early * tolerance + byte_slack) {
+      snprintf(line, sizeof(line), "%s grew from %.0f to %.0f bytes",
+               containerName(container), early, late);
+      failures.push_back(line);
+    }
+  }
+
+  double early = median(samples, first, middle);
+  double late = median(samples, middle, samples.size());
+  if (late > early * tolerance) {
+    snprintf(line, sizeof(line),
+             "tick cost rose from %.1f to %.1f ns per entity", early, late);
+    failures.push_back(line);
+  }
+  return failures;
+}
+
+// Allocated, not live, bytes against the limits, at every sample.
+std::vector<std::string> checkLimits(const std::vector<SoakSample>& samples,
+                                     const MemoryLimits& limits) {
+  std::vector<std::string> failures;
+  char line[256];
+  for (size_t i = 0; i < container_count; ++i) {
+    auto container = static_cast<Container>(i);
+    if (!limits[container]) {
+      continue;
+    }
+    size_t peak = 0;
+    for (const auto& sample : samples) {
+      peak = std::max(peak, sample.memory[container].allocated_bytes);
+    }
+    if (peak > limits[container]) {
+      snprintf(line, sizeof(line),
+               "%s allocated %zu bytes, over its limit of %zu",
+               containerName(container), peak, limits[container]);
+      failures.push_back(line);
+    }
+  }
+  return failures;
+}
+
+}  // namespace
+
+SoakResult runSoak(const SoakConfig& config) {
+  Game game(config.seed);
+  game.started = true;
+  game.invulnerable = true;
+  game.memory_limits = config.limits;
+
+  SoakResult result;
+  double window_ns = 0;
+  uint64_t window_entities = 0;
+  auto window_start = std::chrono::steady_clock::now();
+  for (uint64_t tick = 1; tick <= config.ticks; ++tick) {
+    // fire in bursts so that bullets and debris see use too
+    CommandMask commands =
+        tick % 40 < 20 ? commandBit(Command::FIRE) : CommandMask(0);
+    auto start = std::chrono::steady_clock::now();
+    game.step(commands, config.tick_ms);
+    std::chrono::duration<double, std::nano> cost =
+        std::chrono::steady_clock::now() - start;
+    window_ns += cost.count();
+
+    const Cave& cave = game.cave;
+    window_entities += cave.boulders.size() + cave.floor_spiders.size() +
+                       cave.bullets.size() + cave.spits.size() +
+                       cave.debris.size();
+
+    if (tick % config.sample_ticks == 0) {
+      auto now = std::chrono::steady_clock::now();
+      std::chrono::duration<double> wall = now - window_start;
+      result.samples.push_back({
+          .tick = tick,
+          .distance = game.distance(),
+          .ticks_per_second = config.sample_ticks / wall.count(),
+          .ns_per_entity = window_ns / std::max<uint64_t>(window_entities, 1),
+          .memory = cave.memoryUsage(),
+      });
+      window_ns = 0;
+      window_entities = 0;
+      window_start = now;
+    }
+  }
+
+  result.failures = checkGrowth(result.samples, config.growth_tolerance);
+  for (auto& failure : checkLimits(result.samples, config.limits)) {
+    result.failures.push_back(failure);
+  }
+  return result;
+}
+
+std::string soakReport(const SoakResult& result) {
+  std::string report =
+      "tick,distance,ticks_per_second,ns_per_entity,allocated_bytes";
+  for (size_t i = 0; i < container_count; ++i) {
+    report += ",";
+    report += containerName(static_cast<Container>(i));
+  }
+  report += "\n";
+
+  char field[64];
+  for (const auto& sample : result.samples) {
+    snprintf(field, sizeof(field), "%llu,%.1f,%.0f,%.2f,%zu",
+             static_cast<unsigned long long>(sample.tick), sample.distance,
+             sample.ticks_per_second, sample.ns_per_entity,
+             sample.memory.allocatedBytes());
+    report += field;
+    for (const auto& container : sample.memory.containers) {
+      snprintf(field, sizeof(field), ",%zu", container.count);
+      report += field;
+    }
+    report += "\n";
+  }
+
+  for (const auto& failure : result.failures) {
+    report += "FAIL: " + failure + "\n";
+  }
+  if (result.failures.empty()) {
+    report += "PASS\n";
+  }
+  return report;
+}
@@ -0,0 +1,41 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "memory.h"
+#include "replay.h"
+
+struct SoakConfig {
+  int seed = 0;
+  uint64_t ticks = 675000;  // three hours
+  uint32_t tick_ms = default_tick_ms;
+  uint32_t sample_ticks = 3750;  // a minute
+  // how much a late peak may exceed the early one
+  double growth_tolerance = 1.25;
+  // applied to the game; allocated bytes must stay within them
+  MemoryLimits limits;
+};
+
+struct SoakSample {
+  uint64_t tick;
+  double distance;
+  double ticks_per_second;
+  double ns_per_entity;  // tick cost per live boulder, spider, spit, ...
+  MemoryUsage memory;
+};
+
+struct SoakResult {
+  std::vector<SoakSample> samples;
+  std::vector<std::string> failures;
+};
+
+// Runs one invulnerable game for config.ticks and flags containers that
+// keep growing or hold more than their limit, and tick cost that keeps
+// rising.
+SoakResult runSoak(const SoakConfig& config);
+std::string soakReport(const SoakResult& result);
+
+#endif  // SOAK_H
@@ -0,0 +1,62 @@
+#include "state_hash.h"
+
+const char* stateSectionName(StateSection section) {
+  switch (section) {
+    case StateSection::GAME:
+      return "game";
+    case StateSection::SHIP:
+      return "ship";
+    case StateSection::RANDOM:
+      return "random";
+    case StateSection::BOULDERS:
+      return "boulders";
+    case StateSection::ENVELOPE:
+      return "envelope";
+    case StateSection::SPIDERS:
+      return "spiders";
+    case StateSection::BULLETS:
+      return "bullets";
+    case StateSection::SPITS:
+      return "spits";
+    case StateSection::DEBRIS:
+      return "debris";
+    case StateSection::BACKGROUND:
+      return "background";
+    case StateSection::GENERATION:
+      return "generation";
+    case StateSection::COUNT:
+      break;
+  }
+  return "?";
+}
+
+uint64_t StateHash::combined() const {
+  Hasher hasher;
+  for (uint64_t section : sections) {
+    hasher.add(section);
+  }
+  return hasher.value();
+}
+
+StateDigest StateHash::digest() const {
+  StateDigest digest = {.combined = combined()};
+  for (size_t i = 0; i < state_section_count; ++i) {
+    digest.sections[i] = static_cast<uint8_t>(sections[i] >> 56);
+  }
+  return digest;
+}
+
+std::string divergentSections(const StateDigest& expected,
+                              const StateDigest& actual) {
+  std::string names;
+  for (size_t i = 0; i < state_section_count; ++i) {
+    if (expected.sections[i] != actual.sections[i]) {
+      if (!names.empty()) {
+        names += ", ";
+      }
+      names += stateSectionName(static_cast<StateSection>(i));
+    }
+  }
+  // a byte per section can collide while the combined hash doesn't
+  return names.empty() ? "unknown" : names;
+}
@@ -0,0 +1,121 @@
+#ifndef STATE_HASH_H
+#define STATE_HASH_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// Parts of the simulation state, hashed separately so that the first tick
+// two runs disagree on can be pinned to one of them.
+enum class StateSection {
+  GAME,
+  SHIP,
+  RANDOM,
+  BOULDERS,
+  ENVELOPE,
+  SPIDERS,
+  BULLETS,
+  SPITS,
+  DEBRIS,
+  BACKGROUND,
+  GENERATION,  // everything generated so far, and the job in progress
+  COUNT,
+};
+
+constexpr size_t state_section_count =
+    static_cast<size_t>(StateSection::COUNT);
+
+const char* stateSectionName(StateSection section);
+
+// Streams values into a 64-bit hash. Structs are added field by field, never
+// as raw bytes, so that padding can't make equal states hash differently.
+// Values go round robin into four independent lanes so that the multiplies
+// overlap; pack small fields in pairs where it's hot.
+class Hasher
+{
+ public:
+  void add(uint64_t value) {
+    uint64_t lane = (lanes_[0] ^ value) * 0x9e3779b97f4a7c15ull;
+    lanes_[0] = lanes_[1];
+    lanes_[1] = lanes_[2];
+    lanes_[2] = lanes_[3];
+    lanes_[3] = lane ^ lane >> 29;
+  }
+  void add(int64_t value) { add(static_cast<uint64_t>(value)); }
+  void add(uint32_t value) { add(static_cast<uint64_t>(value)); }
+  void add(int32_t value) { add(static_cast<uint64_t>(value)); }
+  void add(bool value) { add(static_cast<uint64_t>(value)); }
+  void add(float value) { add(std::bit_cast<uint32_t>(value)); }
+  void add(double value) { add(std::bit_cast<uint64_t>(value)); }
+  template <typename E>
+    requires std::is_enum_v<E>
+  void add(E value) {
+    add(static_cast<uint64_t>(value));
+  }
+  // Two 32-bit fields as one value.
+  template <typename A, typename B>
+    requires(sizeof(A) == 4 && sizeof(B) == 4)
+  void add(A a, B b) {
+    add(static_cast<uint64_t>(std::bit_cast<uint32_t>(a)) |
+        static_cast<uint64_t>(std::bit_cast<uint32_t>(b)) << 32);
+  }
+
+  // For objects without padding, such as random engines.
+  template <typename T>
+  void addBytes(const T& value) {
+    static_assert(std::has_unique_object_representations_v<T>);
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    for (size_t i = 0; i < sizeof(T); i += 8) {
+      uint64_t word = 0;
+      std::memcpy(&word, bytes + i, std::min<size_t>(8, sizeof(T) - i));
+      add(word);
+    }
+  }
+
+  uint64_t value() const {
+    uint64_t hash = 0;
+    for (uint64_t lane : lanes_) {
+      hash = (hash ^ lane) * 0x9e3779b97f4a7c15ull;
+      hash ^= hash >> 29;
+    }
+    return hash;
+  }
+
+ private:
+  std::array<uint64_t, 4> lanes_ = {0xcbf29ce484222325ull, 1, 2, 3};
+};
+
+// What a replay keeps of a tick: the combined hash and a byte of every
+// section, enough to name the sections that diverged.
+struct StateDigest {
+  uint64_t combined = 0;
+  std::array<uint8_t, state_section_count> sections = {};
+
+  bool operator==(const StateDigest& other) const = default;
+};
+
+struct StateHash {
+  std::array<uint64_t, state_section_count> sections = {};
+
+  uint64_t& operator[](StateSection section) {
+    return sections[static_cast<size_t>(section)];
+  }
+  uint64_t operator[](StateSection section) const {
+    return sections[static_cast<size_t>(section)];
+  }
+  uint64_t combined() const;
+  StateDigest digest() const;
+};
+
+// Names of the sections that differ between two digests, e.g.
+// "boulders, spiders".
+std::string divergentSections(const StateDigest& expected,
+                              const StateDigest& actual);
+
+#endif  // STATE_HASH_H
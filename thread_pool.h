@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent workers that split index ranges between them. Indices are
+// handed out one at a time from a shared counter, so a worker that finishes
+// early keeps taking work from the ones stuck on long jobs.
+class ThreadPool
+{
+ public:
+  // Counts the calling thread, which takes part in every parallelFor.
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Calls task(i) for every i in [0, count) and waits for all of them.
+  void parallelFor(size_t count, const std::function<void(size_t)>& task);
+  size_t size() const;
+
+ private:
+  void work();
+  void drain();
+
+ private:
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+
+  const std::function<void(size_t)>* task_ = nullptr;
+  size_t count_ = 0;
+  std::atomic<size_t> next_ = 0;
+  size_t pending_ = 0;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+};
+
+#endif  // THREAD_POOL_H
@@ -3,3 +3,18 @@
 float sqdist(float ax, float ay, float bx, float by) {
   return (ax - bx) * (ax - bx) + (ay - by) * (ay - by);
 }
+
+namespace {
+
+uint64_t splitmix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+}  // namespace
+
+uint64_t hash64(uint64_t a, uint64_t b) {
+  return splitmix64(splitmix64(a) ^ b);
+}
@@ -1,7 +1,11 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <cstdint>
+
 float sqdist(float ax, float ay, float bx, float by);
+// Well mixed 64 bits from two values, e.g. a seed and an index.
+uint64_t hash64(uint64_t a, uint64_t b);
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846264338327950288